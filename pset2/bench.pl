@@ -0,0 +1,257 @@
+#! /usr/bin/perl
+
+# bench.pl
+#    Performance regression harness. Runs every io61 test program over a
+#    matrix of file sizes, block sizes and strides, several trials each,
+#    with a warm and/or cold page cache, and reports the median wall time
+#    with its spread plus the counters io61_profile_end() prints: system
+#    calls, context switches, page faults and memory.
+#
+#    Usage: perl bench.pl [-n TRIALS] [-m warm|cold|both] [-s]
+#                         [-o SAVEFILE] [-d BASEFILE] [-t PERCENT] [PATTERN...]
+#
+#    -n TRIALS    trials per case (default 5)
+#    -m MODE      page cache state before each trial (default warm); cold
+#                 runs evict the input file with `dd iflag=nocache`
+#    -s           also run the stdio versions and report the ratio
+#    -o SAVEFILE  save the results as a baseline
+#    -d BASEFILE  compare with a saved baseline; exits 1 on a regression
+#    -t PERCENT   slowdown that counts as a regression (default 10)
+#    PATTERN      only run cases whose name contains one of the patterns
+
+use Time::HiRes;
+use POSIX;
+use Getopt::Std;
+
+my(%opt);
+getopts("n:m:so:d:t:", \%opt) or die "usage: perl bench.pl [-n TRIALS] [-m warm|cold|both] [-s] [-o SAVEFILE] [-d BASEFILE] [-t PERCENT] [PATTERN...]\n";
+my($ntrials) = $opt{"n"} || 5;
+my($mode) = $opt{"m"} || "warm";
+my($threshold) = defined($opt{"t"}) ? $opt{"t"} : 10;
+my(@modes) = $mode eq "both" ? ("warm", "cold") : ($mode);
+my(@counters) = ("utime", "stime", "maxrss", "minflt", "majflt",
+                 "nvcsw", "nivcsw", "syscr", "syscw");
+
+# input files, named as in check.pl
+my(@sizes) = (["text1meg.txt", 1 << 20],
+              ["text5meg.txt", 5 << 20],
+              ["text20meg.txt", 20 << 20]);
+
+# arguments per program, and the largest input each runs on; byte-at-a-time
+# patterns stay on smaller files so the matrix finishes in minutes
+my(%matrix) = (
+    "blockcat61" => [["-b 1", 5 << 20], ["-b 512", 0], ["-b 4096", 0], ["-b 65536", 0]],
+    "randomcat61" => [["-b 1024 -S 6582", 0], ["-b 4096 -S 6582", 0]],
+    "reordercat61" => [["-b 512 -S 6582", 0], ["-b 4096 -S 6582", 0]],
+    "stridecat61" => [["-b 1 -s 1024", 1 << 20], ["-b 4096 -s 1048576", 0]],
+    "ostridecat61" => [["-b 1 -s 1024", 1 << 20], ["-b 4096 -s 1048576", 0]],
+    "gathercat61" => [["-b 1 -s 1024", 1 << 20], ["-b 4096 -s 1048576", 0]],
+    "reverse61" => [["", 5 << 20]]
+);
+
+# pipeexchange61 talks to itself over pipes and takes no input file;
+# threadcat61 and rwcat61 name their output files, which the matrix's
+# `./PROGRAM ARGS INPUT > files/out.txt` commands cannot express
+my(%skip) = ("pipeexchange61" => 1, "threadcat61" => 1, "rwcat61" => 1);
+
+sub makefile ($$) {
+    my($filename, $size) = @_;
+    if (!-r $filename || -s $filename != $size) {
+        truncate($filename, 0);
+        while (-s $filename < $size) {
+            system("cat /usr/share/dict/words >> $filename");
+        }
+        truncate($filename, $size);
+    }
+}
+
+# programs(): the TESTS list from GNUmakefile
+sub programs () {
+    open(my $mk, "<", "GNUmakefile") or die "GNUmakefile: $!\n";
+    my($text) = join("", <$mk>);
+    close($mk);
+    $text =~ s/\\\n/ /g;
+    $text =~ m/^TESTS\s*=\s*(.*)$/m or die "GNUmakefile: no TESTS\n";
+    return grep { $_ ne "" && !$skip{$_} } split(/\s+/, $1);
+}
+
+# run_once(command, cold, input)
+#    Run `command` once; return the JSON counters io61_profile_end()
+#    wrote to file descriptor 100, or undef if it failed or timed out.
+sub run_once ($$$) {
+    my($command, $cold, $input) = @_;
+    system("dd if=$input iflag=nocache count=0 status=none") if $cold;
+
+    my($pr, $pw) = POSIX::pipe();
+    my($pid) = fork();
+    if ($pid == 0) {
+        setpgrp(0, 0);
+        POSIX::close($pr);
+        POSIX::dup2($pw, 100);
+        POSIX::close($pw);
+        exec("sh", "-c", $command);
+        exit(127);
+    }
+    POSIX::close($pw);
+
+    my($before) = Time::HiRes::time();
+    my($status);
+    eval {
+        local $SIG{"ALRM"} = sub { die "timeout\n"; };
+        alarm(60);
+        waitpid($pid, 0);
+        $status = $?;
+        alarm(0);
+    };
+    if ($@) {
+        kill 9, -$pid;
+        waitpid($pid, 0);
+        POSIX::close($pr);
+        return undef;
+    }
+    my($delta) = Time::HiRes::time() - $before;
+
+    my($buf) = "";
+    my($nb) = POSIX::read($pr, $buf, 20000);
+    POSIX::close($pr);
+    return undef if $status != 0;
+
+    my($answer) = {};
+    while (defined($nb) && $buf =~ m,\"(.*?)\"\s*:\s*(-?[\d.]+),g) {
+        $answer->{$1} = $2;
+    }
+    $answer->{"time"} = $delta if !defined($answer->{"time"});
+    return $answer;
+}
+
+sub median (@) {
+    my(@v) = sort { $a <=> $b } @_;
+    return @v ? $v[int(@v / 2)] : 0;
+}
+
+# run_case(command, cold, input)
+#    Run `command` for every trial (after one untimed run to warm the
+#    cache) and summarize the trials.
+sub run_case ($$$) {
+    my($command, $cold, $input) = @_;
+    run_once($command, 0, $input) if !$cold;
+
+    my(@trials);
+    for (my $i = 0; $i < $ntrials; ++$i) {
+        my($t) = run_once($command, $cold, $input);
+        return undef if !$t;
+        push @trials, $t;
+    }
+
+    my(@times) = map { $_->{"time"} } @trials;
+    my($mean) = 0;
+    $mean += $_ foreach @times;
+    $mean /= @times;
+    my($var) = 0;
+    $var += ($_ - $mean) ** 2 foreach @times;
+    $var /= @times > 1 ? @times - 1 : 1;
+
+    my($r) = {"time" => median(@times), "mean" => $mean,
+              "stddev" => sqrt($var), "min" => (sort { $a <=> $b } @times)[0]};
+    foreach my $c (@counters) {
+        $r->{$c} = median(map { defined($_->{$c}) ? $_->{$c} : -1 } @trials);
+    }
+    return $r;
+}
+
+sub load_baseline ($) {
+    my($filename) = @_;
+    my(%base);
+    open(my $fh, "<", $filename) or die "$filename: $!\n";
+    while (my $l = <$fh>) {
+        chomp $l;
+        next if $l =~ /^#/ || $l eq "";
+        my($name, @fields) = split(/\t/, $l);
+        $base{$name} = {map { split(/=/, $_, 2) } @fields};
+    }
+    close($fh);
+    return \%base;
+}
+
+if (!-d "files" && (-e "files" || !mkdir("files"))) {
+    print STDERR "*** Cannot run benchmarks because 'files' cannot be created.\n";
+    exit(1);
+}
+makefile("files/$_->[0]", $_->[1]) foreach @sizes;
+
+my($base) = $opt{"d"} ? load_baseline($opt{"d"}) : undef;
+my(@results);
+my($nregress, $nimprove, $nfailed) = (0, 0, 0);
+
+printf("%-48s %10s %7s %8s %8s %6s %6s %7s%s\n", "CASE", "MEDIAN", "+/-%",
+       "SYSCALLS", "CTXSW", "FAULTS", "RSSKiB", "",
+       $opt{"s"} ? "   STDIO  RATIO" : "");
+foreach my $prog (programs()) {
+    foreach my $args (@{$matrix{$prog} || [["", 0]]}) {
+        foreach my $size (@sizes) {
+            next if $args->[1] && $size->[1] > $args->[1];
+            foreach my $m (@modes) {
+                my($name) = join(" ", grep { $_ ne "" } ($prog, $args->[0], $size->[0], $m));
+                next if @ARGV && !grep { index($name, $_) >= 0 } @ARGV;
+
+                my($input) = "files/$size->[0]";
+                my($command) = "./$prog $args->[0] $input > files/out.txt";
+                printf("%-48s ", $name);
+                my($r) = run_case($command, $m eq "cold", $input);
+                if (!$r) {
+                    print "FAILED\n";
+                    ++$nfailed;
+                    next;
+                }
+                printf("%9.5fs %6.1f%% %8d %8d %6d %6d ",
+                       $r->{"time"}, $r->{"time"} ? 100 * $r->{"stddev"} / $r->{"mean"} : 0,
+                       $r->{"syscr"} + $r->{"syscw"}, $r->{"nvcsw"} + $r->{"nivcsw"},
+                       $r->{"minflt"} + $r->{"majflt"}, $r->{"maxrss"});
+
+                my($note) = "";
+                if ($base && $base->{$name} && $base->{$name}->{"time"} > 0) {
+                    # a change counts only beyond both the threshold and the noise
+                    my($old) = $base->{$name};
+                    my($change) = $r->{"time"} / $old->{"time"} - 1;
+                    my($noise) = 2 * ($r->{"stddev"} + $old->{"stddev"}) / $old->{"time"};
+                    my($limit) = $threshold / 100 > $noise ? $threshold / 100 : $noise;
+                    $note = sprintf("%+6.1f%%", 100 * $change);
+                    if ($change > $limit) {
+                        $note .= " REGRESSION";
+                        ++$nregress;
+                    } elsif ($change < -$limit) {
+                        $note .= " improved";
+                        ++$nimprove;
+                    }
+                }
+                printf("%7s", $note);
+
+                if ($opt{"s"}) {
+                    my($sr) = run_case("./stdio-$prog $args->[0] $input > files/baseout.txt",
+                                       $m eq "cold", $input);
+                    if ($sr) {
+                        $r->{"stdio"} = $sr->{"time"};
+                        printf(" %8.5fs %5.2fx", $sr->{"time"}, $sr->{"time"} / $r->{"time"});
+                    }
+                }
+                print "\n";
+                push @results, [$name, $r];
+            }
+        }
+    }
+}
+
+if ($opt{"o"}) {
+    open(my $fh, ">", $opt{"o"}) or die "$opt{o}: $!\n";
+    print $fh "# bench.pl baseline: $ntrials trials, ", scalar(localtime()), "\n";
+    foreach my $res (@results) {
+        print $fh join("\t", $res->[0], map { "$_=$res->[1]->{$_}" } sort keys %{$res->[1]}), "\n";
+    }
+    close($fh);
+    print "\nSaved ", scalar(@results), " results to $opt{o}\n";
+}
+
+print "\nSUMMARY:   ", scalar(@results), " cases, $nfailed failed";
+print ", $nregress regressions, $nimprove improvements (threshold $threshold%)" if $base;
+print "\n";
+exit($nregress || $nfailed ? 1 : 0);
@@ -1,15 +1,23 @@
 #include "io61.h"
 
-// Usage: ./blockcat61 [-b BLOCKSIZE] [FILE]
+// Usage: ./blockcat61 [-b BLOCKSIZE] [-B BUFSIZE] [FILE]
 //    Copies the input FILE to standard output one block at a time.
-//    Default BLOCKSIZE is 4096.
+//    Default BLOCKSIZE is 4096. If BUFSIZE is given, the stream buffers
+//    are resized to BUFSIZE bytes with io61_bufsize after the first block.
 
 int main(int argc, char** argv) {
     // Parse arguments
     size_t blocksize = 4096;
-    if (argc >= 3 && strcmp(argv[1], "-b") == 0) {
-        blocksize = strtoul(argv[2], 0, 0);
-        argc -= 2, argv += 2;
+    size_t bufsize = 0;
+    while (argc >= 3) {
+        if (strcmp(argv[1], "-b") == 0) {
+            blocksize = strtoul(argv[2], 0, 0);
+            argc -= 2, argv += 2;
+        } else if (strcmp(argv[1], "-B") == 0) {
+            bufsize = strtoul(argv[2], 0, 0);
+            argc -= 2, argv += 2;
+        } else
+            break;
     }
 
     // Allocate buffer, open files
@@ -27,6 +35,11 @@ int main(int argc, char** argv) {
         if (amount <= 0)
             break;
         io61_write(outf, buf, amount);
+        if (bufsize) {
+            io61_bufsize(inf, bufsize);
+            io61_bufsize(outf, bufsize);
+            bufsize = 0;
+        }
     }
 
     io61_close(inf);
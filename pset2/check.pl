@@ -83,7 +83,7 @@ sub run_time ($;$$$$) {
 
     POSIX::close($pw);
     my($nb, $buf);
-    $nb = POSIX::read($pr, $buf, 2000);
+    $nb = POSIX::read($pr, $buf, 20000);
     POSIX::close($pr);
 
     my($answer) = {};
@@ -94,6 +94,8 @@ sub run_time ($;$$$$) {
     $answer->{"utime"} = $delta if !defined($answer->{"utime"});
     $answer->{"stime"} = $delta if !defined($answer->{"stime"});
     $answer->{"maxrss"} = -1 if !defined($answer->{"maxrss"});
+    $answer->{"syscalls"} = $answer->{"syscr"} + $answer->{"syscw"}
+        if defined($answer->{"syscr"}) && $answer->{"syscr"} >= 0;
 
     POSIX::close($ow);
     $buf = undef;
@@ -151,8 +153,9 @@ sub run ($$$$;$) {
     $base =~ s<out\.txt><baseout\.txt>g;
     print "TEST:      $number. $desc\nCOMMAND:   $command\nSTDIO:     ";
     my($t) = run_time_median($base);
-    printf("%.5fs (%.5fs user, %.5fs system, %dKiB memory)\nYOUR CODE: ",
-           $t->{"time"}, $t->{"utime"}, $t->{"stime"}, $t->{"maxrss"});
+    printf("%.5fs (%.5fs user, %.5fs system, %dKiB memory%s)\nYOUR CODE: ",
+           $t->{"time"}, $t->{"utime"}, $t->{"stime"}, $t->{"maxrss"},
+           defined($t->{"syscalls"}) ? ", $t->{syscalls} syscalls" : "");
     if ($base =~ m<files/baseout\.txt>) {
         $outsize = (-s "files/baseout.txt") * 2;
     }
@@ -161,8 +164,9 @@ sub run ($$$$;$) {
         printf "KILLED (%s)\n", $tt->{"error"};
         ++$nkilled;
     } else {
-        printf("%.5fs (%.5fs user, %.5fs system, %dKiB memory)\n",
-               $tt->{"time"}, $tt->{"utime"}, $tt->{"stime"}, $tt->{"maxrss"});
+        printf("%.5fs (%.5fs user, %.5fs system, %dKiB memory%s)\n",
+               $tt->{"time"}, $tt->{"utime"}, $tt->{"stime"}, $tt->{"maxrss"},
+               defined($tt->{"syscalls"}) ? ", $tt->{syscalls} syscalls" : "");
         printf("RATIO:     %.2fx stdio", $t->{"time"} / $tt->{"time"});
         if ($tt->{"medianof"} != 1 && $tt->{"medianof"} == $t->{"medianof"}) {
             printf(" (median of %d trials)", $tt->{"medianof"});
@@ -306,4 +310,148 @@ run(20, "files/text5meg.txt",
     "./stridecat61 -s 1048576 files/text5meg.txt > files/out.txt",
     "1MB stride medium file", 20);
 
+run(21, "files/text20meg.txt",
+    "./copycat61 files/text20meg.txt > files/out.txt",
+    "whole-file copy regular large file", 20);
+
+run(22, "files/text20meg.txt",
+    "cat files/text20meg.txt | ./copycat61 | cat > files/out.txt",
+    "whole-file copy piped large file", 20);
+
+run(23, "files/text20meg.txt",
+    "./linecat61 files/text20meg.txt > files/out.txt",
+    "line-by-line regular large file", 20);
+
+run(24, "files/text20meg.txt",
+    "cat files/text20meg.txt | ./linecat61 | cat > files/out.txt",
+    "line-by-line piped large file", 20);
+
+run(25, "files/text20meg.txt",
+    "IO61_COPYTHREADS=4 ./copycat61 files/text20meg.txt > files/out.txt",
+    "parallel whole-file copy regular large file", 20);
+
+run(26, "files/text5meg.txt",
+    "./gathercat61 -s 1048576 files/text5meg.txt > files/out.txt",
+    "1MB stride gather medium file", 20);
+
+run(27, "files/text20meg.txt",
+    "IO61_MEMBUDGET=256k ./reordercat61 -S 6582 files/text20meg.txt > files/out.txt",
+    "reordered regular large file in a 256KB cache", 20);
+
+run(28, "files/text5meg.txt",
+    "IO61_DURABLE=1m ./blockcat61 -b 4096 files/text5meg.txt > files/out.txt",
+    "durable regular medium file, synced every 1MB", 10);
+
+run(29, "files/text20meg.txt",
+    "IO61_ZIP=1 ./cat61 files/text20meg.txt > files/zip.txt && IO61_ZIP=r ./reordercat61 -S 6582 files/zip.txt > files/out.txt",
+    "compressed regular large file, reordered", 20);
+
+run(30, "files/text20meg.txt",
+    "IO61_CRC=1 ./blockcat61 -b 4096 files/text20meg.txt > files/crc.txt && IO61_CRC=1 ./cat61 files/crc.txt > files/out.txt",
+    "checksummed regular large file, verified on reading", 20);
+
+run(31, "files/text20meg.txt",
+    "./reccat61 -r 320 files/text20meg.txt > files/out.txt",
+    "fixed-size records regular large file", 20);
+
+run(32, "files/text20meg.txt",
+    "cat files/text20meg.txt | ./reccat61 -r 320 -n 7 | cat > files/out.txt",
+    "fixed-size records piped large file, small batches", 20);
+
+run(33, "files/text5meg.txt",
+    "IO61_MEMBUDGET=256k ./reordercat61 files/text5meg.txt > /dev/full 2>/dev/null; echo \$? > files/out.txt",
+    "reordered medium file to a full disk, write error reported", 20);
+
+run(34, "files/text20meg.txt",
+    "IO61_CRC=1 IO61_DURABLE=1m IO61_MEMBUDGET=256k ./threadcat61 files/text5meg.txt files/thread1.txt files/text20meg.txt files/thread2.txt && cat files/thread1.txt files/thread2.txt > files/out.txt",
+    "two threads reorder two files, checksummed and durable, in a 256KB cache", 30);
+
+run(35, "files/text5meg.txt",
+    "cat files/text5meg.txt | IO61_ASYNC=1 ./reccat61 -r 333 | cat > files/out.txt",
+    "fixed-size records piped medium file read ahead, partial last record", 10);
+
+run(36, "files/text5meg.txt",
+    "IO61_CRC=1 ./blockcat61 files/text20meg.txt > files/rewrite.txt && IO61_CRC=1 ./reordercat61 files/text5meg.txt > files/rewrite.txt && IO61_CRC=1 ./cat61 files/rewrite.txt > files/out.txt 2> files/rewrite.err && cat files/rewrite.err >> files/out.txt",
+    "checksummed file rewritten in random order, no stale checksum", 20);
+
+run(37, "files/text20meg.txt",
+    "IO61_URING=1 ./blockcat61 -b 1024 files/text20meg.txt > files/out.txt",
+    "sequential regular large file 1KB through io_uring", 20);
+
+run(38, "files/text5meg.txt",
+    "IO61_URING=1 ./reverse61 files/text5meg.txt > files/out.txt",
+    "reversed medium file through io_uring", 20);
+
+run(39, "files/text20meg.txt",
+    "./vcat61 files/text20meg.txt > files/out.txt",
+    "scatter/gather regular large file", 20);
+
+run(40, "files/text5meg.txt",
+    "cat files/text5meg.txt | ./vcat61 -b 512 -n 64 | cat > files/out.txt",
+    "scatter/gather piped medium file, small fragments", 10);
+
+run(41, "files/text5meg.txt",
+    "IO61_DIRECT=1 ./blockcat61 -b 1000 files/text5meg.txt > files/out.txt",
+    "sequential regular medium file 1000B, direct I/O", 10);
+
+run(42, "files/text20meg.txt",
+    "IO61_DIRECT=1 ./reordercat61 -S 6582 files/text20meg.txt > files/out.txt",
+    "reordered regular large file, direct I/O", 20);
+
+run(43, "files/text20meg.txt",
+    "./rwcat61 files/text20meg.txt files/out.txt",
+    "read/write regular large file, blocks rewritten in place", 20);
+
+run(44, "files/text20meg.txt",
+    "IO61_MEMBUDGET=256k ./rwcat61 -b 1000 -S 6582 files/text20meg.txt files/out.txt",
+    "read/write regular large file 1000B in a 256KB cache", 20);
+
+run(45, "files/text1meg.txt",
+    "./pipeexchange61 > files/out.txt; echo \$? >> files/out.txt",
+    "request/reply exchange over pipes", 10);
+
+run(46, "files/text1meg.txt",
+    "IO61_MSG=0 ./pipeexchange61 > files/out.txt; echo \$? >> files/out.txt",
+    "request/reply exchange over pipes, message mode flushing every write", 10);
+
+run(47, "files/text1meg.txt",
+    "IO61_MSG=4096,200 ./pipeexchange61 > files/out.txt; echo \$? >> files/out.txt",
+    "request/reply exchange over pipes, message mode with a 4KB threshold and 200us delay", 10);
+
+run(48, "files/text5meg.txt",
+    "./pollexchange61 files/text5meg.txt > files/out.txt",
+    "non-blocking relay through an echo process, regular medium file", 10);
+
+run(49, "files/text20meg.txt",
+    "cat files/text20meg.txt | ./pollexchange61 -b 1000 | cat > files/out.txt",
+    "non-blocking relay through an echo process, piped large file 1000B", 20);
+
+run(50, "files/text20meg.txt",
+    "./peekcat61 files/text20meg.txt > files/out.txt",
+    "zero-copy peek/reserve regular large file", 20);
+
+run(51, "files/text5meg.txt",
+    "cat files/text5meg.txt | ./peekcat61 -n 333 | cat > files/out.txt",
+    "zero-copy peek/reserve piped medium file, 333B pieces", 10);
+
+run(52, "files/text20meg.txt",
+    "./blockcat61 -b 1000 -B 1048576 files/text20meg.txt > files/out.txt",
+    "sequential regular large file 1000B, buffers resized to 1MB", 20);
+
+run(53, "files/text5meg.txt",
+    "cat files/text5meg.txt | ./blockcat61 -b 1000 -B 8192 | cat > files/out.txt",
+    "sequential piped medium file 1000B, buffers resized to 8KB", 10);
+
+run(54, "files/text5meg.txt",
+    "cat files/text5meg.txt | IO61_BUFSIZE=64k ./blockcat61 -b 1024 | cat > files/out.txt",
+    "sequential piped medium file 1KB, 64KB buffers", 10);
+
+run(55, "files/text5meg.txt",
+    "IO61_ASYNC=1 ./peekcat61 -n 333 files/text5meg.txt > files/out.txt",
+    "zero-copy peek/reserve regular medium file, async mode", 10);
+
+run(56, "files/text20meg.txt",
+    "IO61_URING=1 ./peekcat61 files/text20meg.txt > files/out.txt",
+    "zero-copy peek/reserve regular large file through io_uring", 20);
+
 summary();
@@ -0,0 +1,22 @@
+#include "io61.h"
+
+// Usage: ./copycat61 [FILE]
+//    Copies the input FILE to standard output with a single io61_copy
+//    call, so the library may move the data without ever reading it.
+
+int main(int argc, char** argv) {
+    const char* in_filename = argc >= 2 ? argv[1] : NULL;
+    io61_profile_begin();
+    io61_file* inf = io61_open_check(in_filename, O_RDONLY);
+    io61_file* outf = io61_fdopen(STDOUT_FILENO, O_WRONLY);
+
+    ssize_t amount = io61_copy(inf, outf, (size_t) -1);
+    if (amount < 0) {
+        fprintf(stderr, "copycat61: copy failed\n");
+        exit(1);
+    }
+
+    io61_close(inf);
+    io61_close(outf);
+    io61_profile_end();
+}
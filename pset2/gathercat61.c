@@ -0,0 +1,61 @@
+#include "io61.h"
+
+// Usage: ./gathercat61 [-b BLOCKSIZE] [-s STRIDE] [FILE]
+//    Copies the input FILE to standard output in the same shuffled order
+//    as stridecat61, but gathers each pass over the file with one call to
+//    io61_read_strided. Default BLOCKSIZE is 1 and default STRIDE is 1024.
+
+int main(int argc, char** argv) {
+    // Parse arguments
+    size_t blocksize = 1;
+    size_t stride = 1024;
+    while (argc >= 3) {
+        if (strcmp(argv[1], "-b") == 0) {
+            blocksize = strtoul(argv[2], 0, 0);
+            argc -= 2, argv += 2;
+        } else if (strcmp(argv[1], "-s") == 0) {
+            stride = strtoul(argv[2], 0, 0);
+            argc -= 2, argv += 2;
+        } else
+            break;
+    }
+    assert(blocksize > 0 && stride > 0);
+    if (blocksize > stride)
+        blocksize = stride;
+
+    const char* in_filename = argc >= 2 ? argv[1] : NULL;
+    io61_profile_begin();
+    io61_file* inf = io61_open_check(in_filename, O_RDONLY);
+
+    size_t inf_size = io61_filesize(inf);
+    if ((ssize_t) inf_size < 0) {
+        fprintf(stderr, "gathercat61: input file is not seekable\n");
+        exit(1);
+    }
+
+    io61_file* outf = io61_fdopen(STDOUT_FILENO, O_WRONLY);
+
+    // Allocate room for one pass: a block from every stride of the file
+    size_t maxcount = (inf_size + stride - 1) / stride;
+    char* buf = malloc(maxcount * blocksize + 1);
+
+    // Copy file data, one pass per block offset within the stride
+    size_t pos = 0, written = 0;
+    while (written < inf_size && pos < stride) {
+        if (pos + blocksize > stride)
+            blocksize = stride - pos;
+        size_t count = (inf_size - pos + stride - 1) / stride;
+        ssize_t amount = io61_read_strided(inf, pos, stride, blocksize,
+                                           count, buf);
+        if (amount <= 0)
+            break;
+        io61_write(outf, buf, amount);
+        written += amount;
+        pos += blocksize;
+    }
+
+    free(buf);
+    io61_close(inf);
+    io61_close(outf);
+    io61_profile_end();
+}
@@ -5,67 +5,552 @@
  * October 2013
  */
 
+#define _GNU_SOURCE     // splice(2)
 #include "io61.h"
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <limits.h>
 #include <errno.h>
 #include <sys/mman.h>
+#include <pthread.h>
+#include <poll.h>
+#include <time.h>
+#include <stdarg.h>
+#include <stdint.h>
+#if defined(__SSE2__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <nmmintrin.h>
+#define HAVE_CRC32C_HW      // the crc32 instruction, used when the CPU has SSE4.2
+#endif
+#ifdef __linux__
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+#include <sys/sendfile.h>
+#ifdef __NR_io_uring_setup
+#define HAVE_URING
+#endif
+#endif
 
 #define STANDALONE      -1
 #define NUMBEROFSLOTS   8192
 #define BUFSIZE         8192
+#define HASHSIZE        NUMBEROFSLOTS           // hash buckets per shard, power of two
+#define NSHARDS         8                       // block cache shards
+#define KIN             (NUMBEROFSLOTS / 4)     // target size of the 2Q A1in queue
+#define KOUT            (NUMBEROFSLOTS / 2)     // number of A1out ghost entries
+#define DIRTYMAX        (NUMBEROFSLOTS / 2)     // dirty blocks past which writers recycle their own
+#define POOLBUFS        (NUMBEROFSLOTS + 64)    // buffers in the pool: every slot plus async rings
+#define PAGESIZE        4096                    // alignment of every buffer (enough for O_DIRECT)
+#define MAXBUFSIZE      (1 << 20)               // largest stream buffer, set or tuned
+#define INITBUFMAX      (64 << 10)              // largest stream buffer a file starts with
+#define TUNEROUND       16                      // full-buffer system calls per tuning measurement
+#define SYNCKICK        (1 << 20)               // durable files start writeback every SYNCKICK bytes
+#define HUGEPAGESIZE    (2 << 20)
 #define SUCCESS         0
 #define FAIL            -1
 #define TRUE            1
 #define FALSE           0
+#define ASYNCBUFS       4       // default number of buffers in async mode
+#define URINGDEPTH      16      // io_uring queue depth and number of registered buffers
+#define IO61_MODEFLAGS  (IO61_URING | IO61_ZIP)
+#ifndef IOV_MAX
+#define IOV_MAX         1024
+#endif
+#ifndef PIPE_BUF
+#define PIPE_BUF        512     // smallest value POSIX allows
+#endif
+#define COPYCHUNK       (1 << 30)   // largest single kernel copy in io61_copy
+#define PCOPYRANGE      (1 << 20)   // parallel copy: bytes a worker copies at a time
+#define PCOPYMIN        (8 << 20)   // smallest copy worth splitting among threads
+#define PCOPYTHREADS    8           // default thread limit of a parallel copy
+#define READBEHIND      16          // most blocks a backward scan loads with one system call
+#define IOVSTACK        16          // io61_readv, io61_writev: fragments copied on the stack
+#define GATHERAHEAD     8           // io61_read_strided prefetches this many blocks ahead
+#define RECALIGN        64          // io61_read_records: alignment of every batch (a cache line)
+#define RECBATCH        (64 << 10)  // io61_read_records: bytes a copied batch holds at most
+#define ZIPBLOCK        (64 << 10)  // raw bytes in a compressed frame, at most 64KB
+#define ZIPBUFS         4           // default number of buffers of a compressed stream
+#define ZIPHASHLOG      13          // compressor hash table: 1 << ZIPHASHLOG positions (fits in L1)
+#define ZIPMAGIC        "I61Z"      // starts the header and the trailer of a compressed stream
+#define ZIPVERSION      1
+#define ZIPHEADER       8           // stream header: magic, version
+#define ZIPFRAME        8           // frame header: raw length (0 ends the data), stored length
+#define ZIPTRAILER      24          // trailer: raw length, number of frames, magic, version
+#define CRCPOLY         0x82f63b78  // CRC32C (Castagnoli) polynomial, bit-reversed
+#define CRCSUFFIX       ".crc32c"   // integrity mode: sidecar of a regular file
+
+#define NLATENCY        8           // latency buckets: under 1, 4, 16, 64, 256, 1024, 4096 us, slower
+#define NFILESTATS      16          // closed files whose counters io61_profile_counters lists
+
+enum { COPY_BUFFERED, COPY_RANGE, COPY_SENDFILE, COPY_SPLICE };
+
+enum { SYS_READ, SYS_READV, SYS_PREAD, SYS_WRITE, SYS_WRITEV, SYS_PWRITE,
+       SYS_LSEEK, SYS_COPY, SYS_URING, SYS_POLL, SYS_SYNC, SYS_SYNCRANGE, NSYSCALLS };
+
+/**
+ * Counters of one file, or of the whole process. Hit bytes pass through a stream buffer, or are
+ * copied to or from a block that was already cached; a miss is a trip to the file that a
+ * request forced. Stream buffers count their bytes in bulk as they are filled and flushed, so
+ * byte-at-a-time calls cost nothing extra. Hits and misses describe the stream buffers and the
+ * block cache; the helper thread and io_uring backends only count system calls and bytes.
+ * System call fields are updated atomically, since helper threads make system calls too; the
+ * others belong to the application.
+ */
+typedef struct io61_stats{
+    unsigned long       calls[NSYSCALLS];               // system calls by type
+    unsigned long       latency[NSYSCALLS][NLATENCY];   // system calls by duration
+    unsigned long       errors;                         // failed system calls
+    unsigned long long  bytesin;                        // bytes read from the file
+    unsigned long long  bytesout;                       // bytes written to the file
+    unsigned long long  hitbytes;
+    unsigned long       misses;
+    unsigned long       evictions;                      // cached blocks given up
+    unsigned long       seeks;
+    unsigned long       flushes;                        // flushes that had data to write
+    unsigned long long  mempeak;                        // most buffer bytes held at once
+}io61_stats;
+
+/**
+ * A file-to-file copy shared by the threads of io61_pcopy. Workers claim PCOPYRANGE bytes at a
+ * time and copy them at their own offsets, so the output is in order however the ranges finish.
+ */
+typedef struct pcopyjob{
+    io61_file*      inf;
+    io61_file*      outf;
+    off_t           inpos;      // input offset of the first byte
+    off_t           outpos;     // output offset of the first byte
+    size_t          len;
+    size_t          next;       // first byte no worker has claimed yet
+    size_t          end;        // bytes [0, end) may all be copied; lowered by a failed range
+    int             method;     // COPY_RANGE until the file system refuses it, then COPY_BUFFERED
+    pthread_mutex_t mutex;
+}pcopyjob;
+
+typedef struct filestats{
+    int         fd;
+    int         mode;
+    int         crc;        // integrity mode: `crcin` and `crcout` are valid
+    uint32_t    crcin;
+    uint32_t    crcout;
+    io61_stats  stats;
+}filestats;
 
 struct io61_file {
     int     fd;
     int     mode;
+    int     dir;                // O_RDONLY while the stream buffer holds input, O_WRONLY for output
     int     seq;
     off_t   pos;
+    int     slot;               // stream buffer of a sequential file, -1 if none
+    struct asyncring* async;    // helper thread state, NULL if synchronous
+    struct uringring* uring;    // io_uring backend state, NULL if unused
+    struct zipring* zip;        // compressed stream state, NULL if uncompressed
+    int     direct;             // O_DIRECT: transfers use page-aligned offsets and lengths
+    size_t  dclean;             // direct writer: leading buffered bytes already on disk
+    int     msg;                // message mode (pipes and sockets)
+    size_t  msgthreshold;       // message mode: flush once this many bytes are buffered
+    long    msgdelay;           // message mode: flush output older than this many microseconds, -1 never
+    int     msgstamped;         // message mode: `msgsince` holds the age of the buffered output
+    struct timespec msgsince;
+    struct io61_file* msgnext;  // next file in message mode
+    pthread_t msgowner;         // message mode: thread that put the file in message mode
+    char*   linebuf;            // io61_read_until: records that span buffer refills
+    size_t  linecap;
+    char*   recbuf;             // io61_read_records: RECALIGN-aligned copies of batches
+    size_t  reccap;
+    size_t  rectail;            // io61_read_records: bytes of a partial record held in `recbuf`
+    size_t  recoff;             // rectail: offset of those bytes; io61_read returns them first
+    off_t   lastmiss;           // block cache: lowest block of the last miss, -1 if none
+    int     behind;             // block cache: blocks the next backward miss loads
+    int     pinslot;            // block cache: pinned slot `f` used last, -1 if none
+    int     err;                // block cache: errno of a failed eviction write-back, 0 if none
+    size_t  ndirty;             // block cache: dirty blocks of the file
+    struct cacheshard* shard;   // block cache: shard holding the file's blocks
+    size_t  bufcap;             // stream buffer capacity
+    size_t  memquota;           // most buffer bytes the file may hold, 0 for no limit
+    int     durable;            // group commit: written bytes are synced in batches
+    size_t  syncbytes;          // durable: sync once this many bytes are unsynced
+    long    syncdelay;          // durable: sync bytes unsynced this many microseconds, -1 never
+    long long syncsince;        // durable: io61_clock() when unsynced bytes were first seen, 0 if none
+    unsigned long long synced;  // bytes written when the file was last synced
+    unsigned long long kicked;  // durable: bytes written when writeback was last started
+    size_t  memused;            // buffer bytes the file holds: its slots and rings
+    int     crc;                // integrity mode: the bytes through the descriptor are checksummed
+    uint32_t crcin;             // crc: CRC32C of the bytes read
+    uint32_t crcout;            // crc: CRC32C of the bytes written
+    unsigned long long crcinlen;    // crc: bytes read
+    unsigned long long crcoutlen;   // crc: bytes written
+    int     crceof;             // crc: a read reached the end of the input
+    char*   crcpath;            // crc: sidecar recording the checksum of a regular file, NULL if none
+    int     tuning;             // TRUE while `bufcap` follows measured system calls
+    int     tunecalls;          // tuning: full-buffer system calls this round
+    long long tunens;           // tuning: their nanoseconds
+    double  tunerate;           // tuning: nanoseconds per byte of the previous round, 0 if none
+    const char* map;            // io61_read_strided: read-only mapping of the file, NULL if none
+    size_t  mapsize;            // bytes mapped; (size_t) -1 once the file proved unmappable
+    io61_stats stats;
+    struct io61_file* statnext; // next open file
 };
 
-typedef struct cacheslot{
-    io61_file*  address;
-    //char        data[BUFSIZE];
-    io61_file*  inf;
-    io61_file*  outf;
+typedef struct asyncbuf{
     char*       data;
-    size_t      offset;
-    size_t      bufsize;
-    off_t       pos;        // file position
+    ssize_t     len;        // valid bytes; 0 is end-of-file, -1 is an error
+    size_t      offset;     // consumer position inside the buffer
+}asyncbuf;
+
+/**
+ * Ring of buffers shared between the application and a helper thread.
+ * For readers the helper thread is the producer and fills buffers with read(2);
+ * for writers the application produces full buffers and the helper drains them.
+ * Buffers [cons, cons + count) are owned by the consumer, the rest by the producer.
+ */
+typedef struct asyncring{
+    pthread_t       thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t  produced;   // signalled when `count` grows
+    pthread_cond_t  consumed;   // signalled when `count` shrinks
+    asyncbuf*       bufs;
+    int             nbufs;
+    int             prod;       // index of the buffer being produced
+    int             cons;       // index of the buffer being consumed
+    int             count;      // number of produced, not yet consumed buffers
+    int             held;       // reader has taken bufs[cons] (accessed by the application only)
+    int             stop;       // helper thread must exit
+    int             error;      // errno of the first failed write, 0 if none
+}asyncring;
+
+typedef struct zipbuf{
+    char*       data;       // ZIPBLOCK raw bytes
+    ssize_t     len;        // valid bytes; 0 is end of data, -1 is an error
+    size_t      offset;     // consumer position inside the buffer
+    off_t       rawpos;     // reader: raw offset of the first byte
+}zipbuf;
+
+typedef struct zipframe{
+    off_t       rawpos;     // raw offset of the first byte
+    off_t       zpos;       // offset of the frame header from the stream header
+}zipframe;
+
+/**
+ * A compressed stream: a header, frames of up to ZIPBLOCK raw bytes that are compressed on
+ * their own (or stored, when compression does not pay), an end frame, the index of every
+ * frame's raw and stream offsets, and a trailer. The ring works like the async one, with a
+ * helper thread that compresses and writes full buffers, or reads and decompresses frames
+ * ahead. A reader that seeks elsewhere stops its helper and decompresses frames into the
+ * block cache instead.
+ */
+typedef struct zipring{
+    pthread_t       thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t  produced;   // signalled when `count` grows
+    pthread_cond_t  consumed;   // signalled when `count` shrinks
+    zipbuf*         bufs;
+    int             nbufs;      // 0 once the helper has stopped
+    int             prod;       // index of the buffer being produced
+    int             cons;       // index of the buffer being consumed
+    int             count;      // number of produced, not yet consumed buffers
+    int             held;       // reader has taken bufs[cons] (accessed by the application only)
+    int             stop;       // helper thread must exit
+    int             error;      // errno of the first failed write, 0 if none
+    off_t           zpos;       // offset of the first frame
+    off_t           rawpos;     // reader: raw offset of the next frame; writer: raw bytes written
+    off_t           base;       // file offset of the stream header
+    int             seekable;   // frames are read with pread
+    char*           zdata;      // a stored frame
+    char*           raw;        // reader in the block cache: a decompressed frame
+    uint16_t*       table;      // writer's helper: compressor hash table
+    zipframe*       frames;     // index, with a sentinel for the end frame; NULL if a reader has none
+    size_t          nframes;
+    size_t          framecap;
+    off_t           rawsize;    // reader: raw bytes in the stream, -1 if unknown
+    size_t          mem;        // bytes charged to the file
+}zipring;
+
+#ifdef HAVE_URING
+enum { UB_FREE, UB_FILLING, UB_INFLIGHT, UB_READY };
+
+typedef struct uringbuf{
+    off_t           pos;        // file position of the first byte
+    size_t          len;        // valid bytes (readers) or bytes to write (writers)
+    size_t          done;       // bytes already transferred by earlier, short requests
+    int             state;
+    unsigned long   used;       // last access time, for recycling read blocks
+}uringbuf;
+
+/**
+ * Per-file io_uring instance. Each of the URINGDEPTH buffers is registered with the
+ * kernel and holds one BUFSIZE block; requests are queued in the submission ring and
+ * handed to the kernel in batches, so many offsets cost a single io_uring_enter.
+ */
+typedef struct uringring{
+    int                     ringfd;
+    int                     fd;         // file the requests go to
+    io61_file*              file;
+    int                     writer;
+    int                     fixed;      // buffers are registered
+    void*                   sqmap;
+    void*                   cqmap;
+    size_t                  sqmapsz;
+    size_t                  cqmapsz;
+    size_t                  sqesz;
+    unsigned*               sqhead;
+    unsigned*               sqtail;
+    unsigned*               sqmask;
+    unsigned*               sqarray;
+    unsigned*               cqhead;
+    unsigned*               cqtail;
+    unsigned*               cqmask;
+    struct io_uring_sqe*    sqes;
+    struct io_uring_cqe*    cqes;
+    unsigned                tosubmit;   // queued, not yet submitted requests
+    unsigned                inflight;   // queued or submitted, not yet completed requests
+    char*                   mem;        // URINGDEPTH * BUFSIZE bytes of buffers
+    uringbuf                bufs[URINGDEPTH];
+    int                     cur;        // buffer being read from or written to, -1 if none
+    off_t                   lastblock;  // previous block read, to detect sequential access
+    unsigned long           clock;
+    int                     error;      // errno of the first failed request, 0 if none
+}uringring;
+#endif
+
+/**
+ * A cache slot holds one BUFSIZE buffer. It is either owned by a sequential file as its
+ * stream buffer, or it caches the block at `pos` of a random-access file. Blocks are found
+ * through a hash table keyed by (file, block position) and replaced with the 2Q policy:
+ * blocks seen once wait in the FIFO A1in queue; blocks referenced again while their key is
+ * remembered in the A1out ghost queue are promoted to the LRU Am queue. A one-time scan
+ * therefore only churns A1in and cannot flush the blocks that are really reused.
+ */
+typedef struct cacheslot{
+    io61_file*  address;    // owner, NULL if the slot is free
+    char*       data;       // BUFSIZE bytes, kept across evictions
+    size_t      cap;        // bytes at `data`: BUFSIZE, or more for a large stream buffer
+    size_t      offset;     // stream: read position or number of buffered bytes
+    size_t      bufsize;    // stream: valid bytes (readers) or capacity (writers); block: valid bytes
+    off_t       pos;        // block: file position of the first byte
+    size_t      dirtylo;    // block: bytes [dirtylo, dirtyhi) must be written back
+    size_t      dirtyhi;
+    int         queue;      // Q_FREE, Q_STREAM, Q_A1IN or Q_AM
+    int         pinned;     // block: lent to the application, not to be evicted
+    int         prev;       // neighbours in the free list or in the queue
+    int         next;
+    int         hnext;      // next slot in the same hash bucket
 }cacheslot;
 
-typedef struct filerelation{
-    io61_file* inf;     // reading from this file
-    io61_file* outf;    // writing to this file
-}filerelation;
+typedef struct slotqueue{
+    int         head;       // most recently inserted
+    int         tail;       // next victim
+    int         size;
+}slotqueue;
+
+typedef struct ghost{
+    io61_file*  address;
+    off_t       pos;
+    int         hnext;      // next ghost in the same hash bucket
+}ghost;
+
+/**
+ * The block cache is split into NSHARDS shards, so threads working on different files rarely
+ * wait for each other. Each file is given a shard when it is opened, and its blocks are
+ * hashed, queued and remembered as ghosts there only. The shard's lock covers those tables
+ * and the blocks themselves. Slots move between shards: a free slot belongs to none, a
+ * block slot to the shard of its file, and a stream buffer only to its file.
+ */
+typedef struct cacheshard{
+    pthread_mutex_t lock;
+    int         ready;                  // tables are initialized
+    int         hashtable[HASHSIZE];    // first slot of each bucket
+    ghost       ghosts[KOUT];           // A1out: keys of blocks recently evicted from A1in
+    int         ghosthash[HASHSIZE];
+    int         ghostnext;              // ring position of the oldest ghost
+    slotqueue   a1in, am;
+    int         sorted[NUMBEROFSLOTS];  // io61_flushdata: dirty slots in file order
+}cacheshard;
+
+enum { Q_FREE, Q_STREAM, Q_A1IN, Q_AM };
+
+typedef struct pollmember{
+    io61_file*  f;
+    int         events;     // POLLIN and/or POLLOUT, as asked by the caller
+    int         registered; // events the kernel watches for; -1 if `f` is always ready
+}pollmember;
 
-filerelation rw;       
+struct io61_pollset{
+    int         epfd;       // epoll instance (Linux)
+    pollmember* members;
+    int         n;
+    int         cap;
+};
 
 struct cacheslot cache[NUMBEROFSLOTS];
+cacheshard shards[NSHARDS];
+unsigned nextshard = 0;             // shard of the next file opened
+int freeslots = -1;                 // free list, linked through `next`
+size_t ndirty = 0;                  // dirty blocks in the cache, updated atomically
+pthread_mutex_t slotlock = PTHREAD_MUTEX_INITIALIZER;      // covers `freeslots`
+pthread_once_t cacheonce = PTHREAD_ONCE_INIT;
+
+char* bufpool = NULL;               // POOLBUFS * BUFSIZE bytes, reserved on first use
+char* poolfree = NULL;              // free buffers, linked through their first word
+size_t poolnext = 0;                // buffers never handed out start here
+pthread_mutex_t poollock = PTHREAD_MUTEX_INITIALIZER;      // covers the pool
+
+size_t membudget = 0;               // bytes io61 buffers may take up, 0 for no limit
+size_t memquota = 0;                // default share of one file, 0 for no limit
+size_t memused = 0;                 // bytes of buffers handed out
+size_t mempeak = 0;
+pthread_once_t memonce = PTHREAD_ONCE_INIT;     // IO61_MEMBUDGET and IO61_MEMQUOTA are read once
+
+io61_file* msgfiles = NULL;         // files in message mode, flushed when a reader goes idle
+pthread_mutex_t msglock = PTHREAD_MUTEX_INITIALIZER;       // covers `msgfiles`
 
-int cacheready = 0;
-int toevict = 0;        // index of the cache slot, that will be evicted next
+io61_file* openfiles = NULL;        // every open file, for io61_profile_counters
+io61_stats totals;                  // counters of closed files and of calls that belong to none
+filestats closedstats[NFILESTATS];  // the first files closed
+int nclosed = 0;                    // number of files closed
+pthread_mutex_t statslock = PTHREAD_MUTEX_INITIALIZER;     // covers the file lists and counters above
+int copythreads = 0;                // threads of a parallel copy, 0 for the default
+uint32_t crctable[8][256];          // CRC32C slice-by-8 tables
+int crchw = FALSE;                  // the CPU has the crc32 instruction
+pthread_once_t crconce = PTHREAD_ONCE_INIT;
+const char* sysnames[NSYSCALLS] = {"read", "readv", "pread", "write", "writev", "pwrite",
+                                   "lseek", "copy", "uring", "poll", "sync", "syncrange"};
 
 int io61_getslot(io61_file*);
+void io61_bufinit(io61_file*);
+size_t io61_bufround(size_t);
+void io61_streambuf(io61_file*, int);
+void io61_tune(io61_file*, size_t, long long);
+void io61_meminit(void);
+size_t io61_parsesize(const char*);
+void io61_memadd(ssize_t);
+void io61_fileadd(io61_file*, ssize_t);
+int io61_overbudget(io61_file*, size_t);
+void io61_release(int);
+void io61_memtrim(void);
 void io61_cacheinit(void);
-int io61_evict(void);
-ssize_t io61_write_mmap(io61_file*, const char*, size_t);
+cacheshard* io61_shardfor(void);
+char* io61_bufalloc(void);
+void io61_buffree(char*);
+int io61_victim(slotqueue*, io61_file*, io61_file*);
+int io61_evict(cacheshard*, io61_file*, io61_file*);
+int io61_dirtyfull(void);
+void io61_putslot(int);
+void io61_freeslot(int);
+unsigned io61_hash(io61_file*, off_t);
+int io61_findblock(io61_file*, off_t);
+int io61_lookup(io61_file*, off_t);
+void io61_pin(io61_file*, int);
+int io61_claimslot(io61_file*);
+void io61_insertblock(io61_file*, int, off_t);
+int io61_loadblock(io61_file*, off_t, int);
+int io61_readbehind(io61_file*, off_t);
+int io61_mapview(io61_file*, size_t);
+int io61_writeback(int);
+void io61_markdirty(int, size_t, size_t);
+void io61_enqueue(slotqueue*, int, int);
+void io61_dequeue(int);
+void io61_unhash(int);
+int io61_isghost(io61_file*, off_t);
+void io61_addghost(cacheshard*, io61_file*, off_t);
+void io61_unghost(cacheshard*, int);
+void io61_dropblocks(io61_file*);
+ssize_t io61_write_cached(io61_file*, const char*, size_t);
 ssize_t io61_write_seq(io61_file*, const char*, size_t);
-ssize_t io61_read_mmap(io61_file*, char*, size_t);
+ssize_t io61_read_cached(io61_file*, char*, size_t);
 ssize_t io61_read_seq(io61_file*, char*, size_t);
-int io61_sortcache(io61_file*);
-void quicksort(int, int);
+int io61_sortcache(io61_file*, int*);
+void quicksort(int*, int, int);
+void* io61_async_reader(void*);
+void* io61_async_writer(void*);
+int io61_async_stop(io61_file*);
+asyncbuf* io61_async_rdbuf(asyncring*);
+asyncbuf* io61_async_wrbuf(asyncring*);
+int io61_async_readc(io61_file*);
+int io61_async_writec(io61_file*, int);
+ssize_t io61_async_read(io61_file*, char*, size_t);
+ssize_t io61_async_write(io61_file*, const char*, size_t);
+int io61_async_flush(io61_file*);
+int io61_findslot(io61_file*);
+ssize_t io61_writev_all(io61_file*, struct iovec*, int);
+ssize_t io61_fill(io61_file*, int);
+ssize_t io61_refill(io61_file*, int, size_t);
+int io61_pwrite_all(io61_file*, const char*, size_t, off_t);
+int io61_pwrite_buffered(io61_file*, const char*, size_t, off_t);
+int io61_pwrite_direct(io61_file*, const char*, size_t, off_t);
+int io61_turn(io61_file*, int);
+int io61_flushdata(io61_file*);
+int io61_durablecheck(io61_file*);
+int io61_syncnow(io61_file*);
+int io61_syncmode(io61_file*);
+void io61_crcadd(io61_file*, int, const char*, ssize_t);
+void io61_crcaddv(io61_file*, int, const struct iovec*, int, ssize_t);
+int io61_crcclose(io61_file*);
+void io61_crcinit(void);
+uint32_t io61_crc32c(uint32_t, const char*, size_t);
+int io61_msgcheck(io61_file*);
+void io61_msgwait(io61_file*);
+int io61_ready(io61_file*, short);
+const char* io61_memchr(const char*, int, size_t);
+int io61_lineappend(io61_file*, size_t, const char*, size_t);
+int io61_recbuf(io61_file*, size_t);
+ssize_t io61_read_reccopy(io61_file*, size_t, size_t, const void**);
+int io61_pollset_interest(io61_pollset*, int);
+int io61_copythreads(void);
+ssize_t io61_pcopy(io61_file*, io61_file*, off_t, off_t, size_t, int);
+void* io61_pcopy_worker(void*);
+size_t io61_pcopy_range(pcopyjob*, size_t, size_t, char**);
+long long io61_clock(void);
+long long io61_count(io61_file*, int, long long, ssize_t);
+void io61_addstats(io61_stats*, const io61_stats*);
+int io61_jsonf(char*, size_t, int, const char*, ...);
+int io61_statsjson(char*, size_t, const io61_stats*, int);
+int io61_zip_stop(io61_file*);
+void io61_zip_free(io61_file*);
+int io61_zip_index(io61_file*, zipring*);
+ssize_t io61_zip_readall(io61_file*, zipring*, char*, size_t, off_t);
+ssize_t io61_zip_unpack(const char*, size_t, char*);
+void* io61_zip_reader(void*);
+void* io61_zip_writer(void*);
+zipbuf* io61_zip_rdbuf(zipring*);
+zipbuf* io61_zip_wrbuf(zipring*);
+int io61_zip_readc(io61_file*);
+int io61_zip_writec(io61_file*, int);
+ssize_t io61_zip_read(io61_file*, char*, size_t);
+ssize_t io61_zip_write(io61_file*, const char*, size_t);
+int io61_zip_flush(io61_file*);
+int io61_zip_seek(io61_file*, size_t);
+int io61_zip_loadblock(io61_file*, off_t);
+size_t io61_lz_compress(const char*, size_t, char*, size_t, uint16_t*);
+ssize_t io61_lz_decompress(const char*, size_t, char*, size_t);
+void io61_put32(unsigned char*, uint32_t);
+void io61_put64(unsigned char*, uint64_t);
+uint32_t io61_get32(const unsigned char*);
+uint64_t io61_get64(const unsigned char*);
+#ifdef HAVE_URING
+int io61_uring_stop(io61_file*);
+void io61_uring_queue(uringring*, int, int, size_t);
+void io61_uring_submit(uringring*, unsigned);
+unsigned io61_uring_reap(uringring*);
+int io61_uring_find(uringring*, off_t);
+void io61_uring_prefetch(uringring*, off_t, int, int);
+void io61_uring_retire(uringring*);
+ssize_t io61_uring_read(io61_file*, char*, size_t);
+ssize_t io61_uring_write(io61_file*, const char*, size_t);
+int io61_uring_flush(io61_file*);
+#endif
 
 
 /**
- * [io61_fdopen return a new io61_file that reads from and/or writes to the given file descriptor `fd`.
- *              We need not support read/write files.]
+ * [io61_fdopen return a new io61_file that reads from and/or writes to the given file descriptor `fd`.]
  * @param  fd   [file descriptor]
- * @param  mode [is either O_RDONLY for a read-only file or O_WRONLY for a write-only file.]
+ * @param  mode [is O_RDONLY for a read-only file, O_WRONLY for a write-only file or O_RDWR,
+ *               optionally or'ed with IO61_URING to select the io_uring backend, or with
+ *               O_DIRECT to bypass the page cache for a regular file.]
  * @return      [description]
  */
 io61_file* io61_fdopen(int fd, int mode) {
@@ -73,13 +558,123 @@ io61_file* io61_fdopen(int fd, int mode) {
     assert(fd >= 0);
     io61_file* f = (io61_file*) malloc(sizeof(io61_file));
     f -> fd = fd;
-    f -> mode = mode;
+    f -> mode = mode & O_ACCMODE;
     f -> seq = TRUE;        // file is sequential by default
+    f -> slot = -1;
+    f -> async = NULL;
+    f -> uring = NULL;
+    f -> zip = NULL;
+    f -> direct = FALSE;
+    f -> dclean = 0;
+    f -> dir = f -> mode == O_WRONLY ? O_WRONLY : O_RDONLY;
+    f -> msg = FALSE;
+    f -> msgnext = NULL;
+    f -> linebuf = NULL;
+    f -> linecap = 0;
+    f -> recbuf = NULL;
+    f -> reccap = 0;
+    f -> rectail = 0;
+    f -> recoff = 0;
+    f -> lastmiss = -1;
+    f -> behind = 1;
+    f -> pinslot = -1;
+    f -> err = 0;
+    f -> ndirty = 0;
+    f -> shard = io61_shardfor();
+    f -> map = NULL;
+    f -> mapsize = 0;
+    memset(&f -> stats, 0, sizeof(f -> stats));
+    f -> durable = FALSE;
+    f -> syncsince = 0;
+    f -> crc = f -> crceof = FALSE;
+    f -> crcin = f -> crcout = 0;
+    f -> crcinlen = f -> crcoutlen = 0;
+    f -> crcpath = NULL;
+    f -> synced = f -> kicked = 0;
+    pthread_mutex_lock(&statslock);
+    f -> statnext = openfiles;
+    openfiles = f;
+    pthread_mutex_unlock(&statslock);
+    pthread_once(&memonce, io61_meminit);
+    f -> memquota = memquota;
+    f -> memused = 0;
+    io61_bufinit(f);
 
-    if(mode == O_RDONLY)
-        rw.inf = f;
-    else
-        rw.outf = f;        
+    // O_RDWR: a seekable file reads and writes through the block cache, where every block
+    // keeps its own valid and dirty bytes; a socket or FIFO turns its stream buffer around
+    if(f -> mode == O_RDWR)
+    {
+        struct stat s;
+        off_t pos = lseek(fd, 0, SEEK_CUR);
+        if(fstat(fd, &s) == 0 && (S_ISREG(s.st_mode) || S_ISBLK(s.st_mode)) && pos != (off_t) -1)
+        {
+            f -> seq = FALSE;
+            f -> pos = pos;
+        }
+    }
+
+    // IO61_DURABLE=<bytes>[,<delay in microseconds>] makes writers to files commit in groups
+    const char* env = getenv("IO61_DURABLE");
+    if(env && f -> mode != O_RDONLY)
+    {
+        const char* comma = strchr(env, ',');
+        io61_durable(f, io61_parsesize(env), comma ? atol(comma + 1) : -1);
+    }
+
+    // IO61_ZIP=1 compresses what writers write and decompresses what readers read, when it
+    // is a compressed stream; IO61_ZIP=w and IO61_ZIP=r only select writers or readers
+    env = getenv("IO61_ZIP");
+    int zip = (mode & IO61_ZIP) || (env && atoi(env) > 0)
+              || (env && env[0] == (f -> mode == O_RDONLY ? 'r' : 'w'));
+    if(f -> mode != O_RDWR && zip && io61_zip_start(f) == SUCCESS)
+        return f;
+
+    // IO61_DIRECT=1, IO61_URING=1 and IO61_ASYNC=<nbufs> select a mode without changing the caller
+    env = getenv("IO61_DIRECT");
+    if((mode & O_DIRECT) || (env && atoi(env) > 0))
+    {
+        // only regular files take O_DIRECT (on a pipe it means packet mode), and pwrite
+        // ignores offsets under O_APPEND; a file system without direct I/O refuses the
+        // flag and the file stays buffered
+        struct stat s;
+        int fl = fcntl(fd, F_GETFL);
+        off_t pos = lseek(fd, 0, SEEK_CUR);
+        if(fstat(fd, &s) == 0 && S_ISREG(s.st_mode) && fl != -1 && !(fl & O_APPEND)
+           && pos != (off_t) -1
+           && ((fl & O_DIRECT) || fcntl(fd, F_SETFL, fl | O_DIRECT) == 0))
+        {
+            // direct files use pread/pwrite; `pos` is where the stream buffer ends (readers)
+            // or starts (writers)
+            f -> direct = TRUE;
+            f -> pos = pos;
+            return f;
+        }
+    }
+
+    // IO61_CRC=1 checksums what crosses the descriptor; it takes precedence over io_uring
+    env = getenv("IO61_CRC");
+    if(env && atoi(env) > 0)
+        io61_crc_start(f, NULL);
+
+    // the helper thread and io_uring backends stream in one direction
+    if(f -> mode == O_RDWR)
+        return f;
+
+    env = getenv("IO61_URING");
+    if((mode & IO61_URING) || (env && atoi(env) > 0))
+        io61_uring_start(f);
+
+    env = getenv("IO61_ASYNC");
+    if(f -> uring == NULL && env && atoi(env) > 0)
+        io61_async_start(f, atoi(env));
+
+    // IO61_MSG=<threshold>[,<delay in microseconds>] puts pipes and sockets in message mode
+    env = getenv("IO61_MSG");
+    if(f -> async == NULL && f -> uring == NULL && env)
+    {
+        const char* comma = strchr(env, ',');
+        io61_msgmode(f, strtoul(env, NULL, 10), comma ? atol(comma + 1) : -1);
+    }
 
     return f;
 }
@@ -91,9 +686,68 @@ io61_file* io61_fdopen(int fd, int mode) {
  * @return   [description]
  */
 int io61_close(io61_file* f) {
-    io61_flush(f);
+    int r = io61_flush(f);
+
+    // a writer's end frame, index and trailer, and its last queued writes, go out here; a
+    // reader's read-ahead errors were never delivered and do not matter
+    int w = f -> mode != O_RDONLY;
+    if(io61_zip_stop(f) == FAIL && w)
+        r = FAIL;
+    if(io61_async_stop(f) == FAIL && w)
+        r = FAIL;
+#ifdef HAVE_URING
+    if(io61_uring_stop(f) == FAIL && w)
+        r = FAIL;
+#endif
+    if(f -> durable && io61_syncnow(f) == FAIL)
+        r = FAIL;
+    if(f -> crc && f -> crcpath && io61_crcclose(f) == FAIL)
+        r = FAIL;
+
+    // `f` is about to be freed, so nothing may stay cached under its address
+    pthread_mutex_lock(&msglock);
+    for(io61_file** p = &msgfiles; *p; p = &(*p) -> msgnext)
+        if(*p == f)
+        {
+            *p = f -> msgnext;
+            break;
+        }
+    pthread_mutex_unlock(&msglock);
+    if(f -> slot >= 0)
+        io61_putslot(f -> slot);
+    if(f -> seq == FALSE)
+        io61_dropblocks(f);
+    if(f -> zip)
+        io61_zip_free(f);
+
+    // the counters outlive the file
+    pthread_mutex_lock(&statslock);
+    for(io61_file** p = &openfiles; *p; p = &(*p) -> statnext)
+        if(*p == f)
+        {
+            *p = f -> statnext;
+            break;
+        }
+    io61_addstats(&totals, &f -> stats);
+    if(nclosed < NFILESTATS)
+    {
+        closedstats[nclosed].fd = f -> fd;
+        closedstats[nclosed].mode = f -> mode;
+        closedstats[nclosed].crc = f -> crc;
+        closedstats[nclosed].crcin = f -> crcin;
+        closedstats[nclosed].crcout = f -> crcout;
+        closedstats[nclosed].stats = f -> stats;
+    }
+    nclosed++;
+    pthread_mutex_unlock(&statslock);
 
-    int r = close(f->fd);
+    if(close(f->fd) != 0)
+        r = FAIL;
+    free(f -> linebuf);
+    free(f -> recbuf);
+    free(f -> crcpath);
+    if(f -> map)
+        munmap((void*) f -> map, f -> mapsize);
     free(f);
 
     return r;
@@ -108,31 +762,45 @@ int io61_close(io61_file* f) {
  */
 int io61_readc(io61_file* f) {
 
-    for(int i = 0; i < NUMBEROFSLOTS; i++)
+    if(f -> rectail)
     {
-        if(cache[i].address == f)
-        {
-            if(cache[i].offset < BUFSIZE)
-            {
-                return cache[i].data[ cache[i].offset++ ];
-            }else
-            {
-                // finished with this slot.
-                cache[i].address = NULL;                
-                break;
-            }
-        }
+        f -> rectail--;
+        return (unsigned char) f -> recbuf[ f -> recoff++ ];
+    }
+    if(f -> zip && f -> seq)
+        return io61_zip_readc(f);
+    if(f -> async)
+        return io61_async_readc(f);
+#ifdef HAVE_URING
+    if(f -> uring)
+    {
+        unsigned char ch;
+        return io61_uring_read(f, (char*) &ch, 1) == 1 ? ch : EOF;
+    }
+#endif
+    if(f -> seq == FALSE)
+    {
+        unsigned char ch;
+        return io61_read_cached(f, (char*) &ch, 1) == 1 ? ch : EOF;
     }
+    if(f -> mode == O_RDWR && io61_turn(f, O_RDONLY) == FAIL)
+        return EOF;
 
-    // nothing found in a cache:
-    int i = io61_getslot(f);   
-    int bytesread = read(f -> fd, cache[i].data, BUFSIZE);
+    int i = io61_findslot(f);
+    if(i >= 0 && cache[i].offset < cache[i].bufsize)
+        return (unsigned char) cache[i].data[ cache[i].offset++ ];
 
-    if(bytesread == BUFSIZE)
-        return cache[i].data[ cache[i].offset++ ];
+    // the slot is used up: refill it in place
+    if(i < 0)
+        i = io61_getslot(f);
+    if(i < 0)
+        return FAIL;
+    if(f -> msg)
+        io61_msgwait(f);
 
-    // FIXME:
-    return EOF;
+    if(io61_fill(f, i) <= 0)
+        return EOF;
+    return (unsigned char) cache[i].data[ cache[i].offset++ ];
 }
 
 
@@ -145,23 +813,44 @@ int io61_readc(io61_file* f) {
 int io61_writec(io61_file* f, int ch) 
 {
 
-    for(int i = 0; i < NUMBEROFSLOTS; i++)
+    if(f -> zip)
+        return io61_zip_writec(f, ch);
+    if(f -> async)
+        return io61_async_writec(f, ch);
+#ifdef HAVE_URING
+    if(f -> uring)
     {
-        if(cache[i].address == f)
-        {
-            if(cache[i].offset < BUFSIZE)
-            {
-                cache[i].data[ cache[i].offset++ ] = ch;
-                return SUCCESS;
-            }else
-                break;
-        }
+        char c = ch;
+        return io61_uring_write(f, &c, 1) == 1 ? SUCCESS : FAIL;
+    }
+#endif
+    if(f -> seq == FALSE)
+    {
+        char c = ch;
+        return io61_write_cached(f, &c, 1) == 1 ? SUCCESS : FAIL;
+    }
+    if(f -> mode == O_RDWR && f -> dir != O_WRONLY)
+    {
+        char c = ch;
+        return io61_write_seq(f, &c, 1) == 1 ? SUCCESS : FAIL;
     }
 
-    io61_flush(f);
-    int i = io61_getslot(f);
-    cache[i].data[ cache[i].offset++ ] = ch;
+    int i = io61_findslot(f);
+    if(i >= 0 && cache[i].offset == cache[i].bufsize)
+    {
+        // the stream buffer is full
+        f -> stats.misses++;
+        if(io61_flush(f) == FAIL)
+            return FAIL;
+    }
+    if(i < 0)
+        i = io61_getslot(f);
+    if(i < 0)
+        return FAIL;
 
+    cache[i].data[ cache[i].offset++ ] = ch;
+    if(f -> msg)
+        return io61_msgcheck(f);
     return SUCCESS;
 }
 
@@ -174,10 +863,29 @@ int io61_writec(io61_file* f, int ch)
  */
 ssize_t io61_read(io61_file* f, char* buf, size_t sz){
     
+    if(f -> rectail)
+    {
+        // a partial record io61_read_records read but did not return comes first
+        size_t n = f -> rectail < sz ? f -> rectail : sz;
+        memcpy(buf, f -> recbuf + f -> recoff, n);
+        f -> recoff += n;
+        f -> rectail -= n;
+        ssize_t r = n < sz ? io61_read(f, buf + n, sz - n) : 0;
+        return r > 0 ? (ssize_t) n + r : (ssize_t) n;
+    }
+    if(f -> zip && f -> seq)
+        return io61_zip_read(f, buf, sz);
+    if(f -> async)
+        return io61_async_read(f, buf, sz);
+#ifdef HAVE_URING
+    if(f -> uring)
+        return io61_uring_read(f, buf, sz);
+#endif
+
     if(f -> seq == TRUE)   // sequential file
         return io61_read_seq(f, buf, sz);
     else        // random access file
-        return io61_read_mmap(f, buf, sz);
+        return io61_read_cached(f, buf, sz);
 }
 
 /**
@@ -191,56 +899,184 @@ ssize_t io61_read(io61_file* f, char* buf, size_t sz){
  */
 ssize_t io61_read_seq(io61_file* f, char* buf, size_t sz) {
 
-    ssize_t nread;
+    // buffered bytes are copied out; a request of at least BUFSIZE then goes
+    // straight into `buf`, smaller ones share a single read with the refill
+    struct iovec iov;
+    iov.iov_base = buf;
+    iov.iov_len = sz;
 
-    for(int i = 0; i < NUMBEROFSLOTS; i++)
-    {
-        if(cache[i].address == f && cache[i].offset < cache[i].bufsize)
-        {   
-            if(sz > cache[i].bufsize - cache[i].offset)
-                sz = cache[i].bufsize - cache[i].offset;
+    return io61_readv(f, &iov, 1);
+}
+
+/**
+ * [io61_read_cached reads `sz` characters at the file position of `f` through the block cache.
+ *                   Used for random access files.]
+ * @param  f   [file]
+ * @param  buf [destination]
+ * @param  sz  [number of bytes requested]
+ * @return     [number of bytes read; short at end of file; -1 if an error occurred before
+ *              any bytes were read]
+ */
+ssize_t io61_read_cached(io61_file* f, char* buf, size_t sz) {
 
-            memcpy(buf, &cache[i].data[ cache[i].offset ], sz);
-            cache[i].offset += sz;
+    size_t nread = 0;
 
-            return sz;
+    while(nread < sz)
+    {
+        // byte-at-a-time readers keep coming back to the block they used last; it is
+        // pinned, so no other thread can take it and it is checked without the shard lock
+        off_t block = f -> pos - f -> pos % BUFSIZE;
+        int i = f -> pinslot;
+        int hit = TRUE;
+        if(i < 0 || cache[i].pos != block)
+        {
+            pthread_mutex_lock(&f -> shard -> lock);
+            i = io61_lookup(f, block);
+            hit = i >= 0;
+            if(i < 0)
+                i = f -> zip ? io61_zip_loadblock(f, block) : io61_readbehind(f, block);
+            if(i >= 0)
+                io61_pin(f, i);
+            pthread_mutex_unlock(&f -> shard -> lock);
         }
+        if(i < 0)
+            return nread ? (ssize_t) nread : FAIL;
+
+        size_t off = f -> pos - block;
+        if(off >= cache[i].bufsize)
+            break;      // end of file
+
+        size_t n = cache[i].bufsize - off;
+        if(n > sz - nread)
+            n = sz - nread;
+        memcpy(buf + nread, &cache[i].data[off], n);
+        if(hit)
+            f -> stats.hitbytes += n;
+        nread += n;
+        f -> pos += n;
     }
 
-    // nothing found in a cache:
-    int i = io61_getslot(f); 
-    nread = read(f -> fd, cache[i].data, BUFSIZE);
-    cache[i].bufsize = nread;
+    return nread;
+}
 
-    // returning the first chunk of read data:
-    memcpy(buf, cache[i].data, sz);
-    cache[i].offset = sz;
+/**
+ * [io61_mapview maps the read-only regular file `f` so that io61_read_strided can gather from
+ *               memory. The mapping covers the whole file and is made again if the file has
+ *               grown past it. Files that are written, or read through a helper thread,
+ *               io_uring or O_DIRECT, keep their data elsewhere and are never mapped.]
+ * @param  f    [file]
+ * @param  need [bytes the caller wants mapped]
+ * @return      [TRUE if `f -> map` holds the file, FALSE to fall back to the block cache]
+ */
+int io61_mapview(io61_file* f, size_t need)
+{
+    if(f -> mapsize == (size_t) -1)
+        return FALSE;
+    if(f -> map && need <= f -> mapsize)
+        return TRUE;
 
-    if (nread == 0 && sz != 0)
-        return -1;
-    else
-        return sz;
+    struct stat s;
+    if(f -> mode != O_RDONLY || f -> async || f -> uring || f -> zip || f -> direct || f -> crc
+       || fstat(f -> fd, &s) != 0 || !S_ISREG(s.st_mode) || s.st_size == 0)
+    {
+        f -> mapsize = (size_t) -1;
+        return FALSE;
+    }
+    if(f -> map && (size_t) s.st_size <= f -> mapsize)
+        return TRUE;        // the file has not grown; the request runs past its end
+
+    if(f -> map)
+        munmap((void*) f -> map, f -> mapsize);
+
+    // a strided shuffle ends up touching every page, so they are all faulted in at once
+    void* map = mmap(NULL, s.st_size, PROT_READ, MAP_SHARED | MAP_POPULATE, f -> fd, 0);
+    if(map == MAP_FAILED)
+    {
+        f -> map = NULL;
+        f -> mapsize = (size_t) -1;
+        return FALSE;
+    }
+    f -> map = (const char*) map;
+    f -> mapsize = s.st_size;
+    return TRUE;
 }
 
 /**
- * [io61_read_mmap description]
- * @param  f   [description]
- * @param  buf [calling programm expects that this buffer will be used for data interchange, 
- *              but we use it i a different way - buf is storing the pointer to read file structure. 
- *              ]
- * @param  sz  [description]
- * @return     [description]
+ * [io61_read_strided gathers `count` blocks of `blocksize` bytes from positions `start`,
+ *                    `start + stride`, `start + 2 * stride`, ... of `f` into `buf`, one after
+ *                    another. A read-only regular file is gathered straight from a mapping
+ *                    of the file, prefetching GATHERAHEAD blocks ahead, with no system call;
+ *                    other seekable files are gathered through the block cache. The file
+ *                    position is left after the last byte read.]
+ * @param  f         [file]
+ * @param  start     [position of the first block]
+ * @param  stride    [distance between the starts of consecutive blocks]
+ * @param  blocksize [bytes per block]
+ * @param  count     [number of blocks]
+ * @param  buf       [destination, room for `count * blocksize` bytes]
+ * @return           [number of bytes read; short if the file ends first; -1 if an error
+ *                    occurred before any bytes were read]
  */
-ssize_t io61_read_mmap(io61_file* f, char* buf, size_t sz) {
-    (void) buf;
-    (void) f;
+ssize_t io61_read_strided(io61_file* f, size_t start, size_t stride, size_t blocksize,
+                          size_t count, char* buf)
+{
+    size_t nread = 0;
+    if(count == 0 || blocksize == 0)
+        return 0;
+
+    if(io61_mapview(f, start + (count - 1) * stride + 1))
+    {
+        const char* map = f -> map;
+        size_t size = f -> mapsize;
+        size_t pos = start;
+        size_t end = start;     // just past the last byte read
+        size_t k;
+
+        if(blocksize == 1)
+        {
+            // one byte per block: a plain gather loop, no memcpy call per byte
+            for(k = 0; k < count && pos < size; k++, pos += stride)
+            {
+                if(pos + GATHERAHEAD * stride < size)
+                    __builtin_prefetch(map + pos + GATHERAHEAD * stride);
+                buf[k] = map[pos];
+            }
+            nread = k;
+            if(k > 0)
+                end = pos - stride + 1;
+        }else
+        {
+            for(k = 0; k < count && pos < size; k++, pos += stride)
+            {
+                if(pos + GATHERAHEAD * stride < size)
+                    __builtin_prefetch(map + pos + GATHERAHEAD * stride);
+                size_t n = size - pos < blocksize ? size - pos : blocksize;
+                memcpy(buf + nread, map + pos, n);
+                nread += n;
+                end = pos + n;
+                if(n < blocksize)
+                    break;
+            }
+        }
 
-    int i = io61_getslot(f);
-    cache[i].pos = f -> pos;
-    cache[i].data = mmap(NULL, sz, PROT_READ, MAP_PRIVATE, f -> fd, cache[i].pos);
-    cache[i].bufsize = sz;
+        f -> stats.hitbytes += nread;
+        if(nread > 0 && io61_seek(f, end) == FAIL)
+            return FAIL;
+        return nread;
+    }
 
-    return sz;
+    for(size_t k = 0; k < count; k++)
+    {
+        if(io61_seek(f, start + k * stride) == FAIL)
+            return nread ? (ssize_t) nread : FAIL;
+        ssize_t n = io61_read(f, buf + nread, blocksize);
+        if(n <= 0)
+            return nread ? (ssize_t) nread : n;
+        nread += n;
+        if((size_t) n < blocksize)
+            break;
+    }
+    return nread;
 }
 
 
@@ -253,10 +1089,19 @@ ssize_t io61_read_mmap(io61_file* f, char* buf, size_t sz) {
  */ 
 ssize_t io61_write(io61_file* f, const char* buf, size_t sz) {
 
+    if(f -> zip)
+        return io61_zip_write(f, buf, sz);
+    if(f -> async)
+        return io61_async_write(f, buf, sz);
+#ifdef HAVE_URING
+    if(f -> uring)
+        return io61_uring_write(f, buf, sz);
+#endif
+
     if(f -> seq == TRUE)   // sequential file
         return io61_write_seq(f, buf, sz);
     else        // random access file
-        return io61_write_mmap(f, buf, sz);
+        return io61_write_cached(f, buf, sz);
 }
 
 /**
@@ -269,47 +1114,103 @@ ssize_t io61_write(io61_file* f, const char* buf, size_t sz) {
  */
 ssize_t io61_write_seq(io61_file* f, const char* buf, size_t sz) {
 
-    for(int i = 0; i < NUMBEROFSLOTS; i++)
-    {
-        if(cache[i].address == f)
-        {
-            if(cache[i].offset < cache[i].bufsize)
-            {
-                if(sz > cache[i].bufsize - cache[i].offset)
-                    sz = cache[i].bufsize - cache[i].offset;
-
-                memcpy(&cache[i].data[ cache[i].offset ], buf, sz);
-                cache[i].offset += sz;
-                return sz;
-
-            }else // flushing needed
-            {
-                io61_flush(f);
-                break;
-            }
-        }
-    }
-
-    int i = io61_getslot(f);
-    memcpy(cache[i].data, buf, sz);
-    cache[i].offset = sz;
+    // small writes are gathered in the slot; once they no longer fit, the
+    // buffered bytes and `buf` leave together in one writev, without copying `buf`
+    struct iovec iov;
+    iov.iov_base = (char*) buf;
+    iov.iov_len = sz;
 
-    return sz;
+    return io61_writev(f, &iov, 1);
 }
 
 /**
- * [io61_write_mmap writes `sz` characters from `buf` to `f`, using mmap IO.
- *                          Used for random access files.]
+ * [io61_write_cached writes `sz` characters at the file position of `f` through the block cache.
+ *                    Each block remembers one dirty byte range, so blocks of a write-only file
+ *                    never have to be read first. Used for random access files.]
  * @param  f   [file]
  * @param  buf [buffer to write]
  * @param  sz  [size of buffer]
  * @return     [Returns the number of characters written on success; normally this is `sz`. 
  *              Returns -1 if an error occurred before any characters were written.]
  */ 
-ssize_t io61_write_mmap(io61_file* f, const char* buf, size_t sz) {
-    (void) buf;
-    (void) f;
-    return sz;
+ssize_t io61_write_cached(io61_file* f, const char* buf, size_t sz) {
+
+    size_t nwritten = 0;
+    if(f -> err)
+    {
+        errno = f -> err;
+        return FAIL;
+    }
+
+    while(nwritten < sz)
+    {
+        // as in io61_read_cached, the block in use is pinned
+        off_t block = f -> pos - f -> pos % BUFSIZE;
+        int i = f -> pinslot;
+        int hit = TRUE;
+        if(i < 0 || cache[i].pos != block)
+        {
+            pthread_mutex_lock(&f -> shard -> lock);
+            i = io61_lookup(f, block);
+            hit = i >= 0;
+            if(i < 0)
+                i = io61_loadblock(f, block, f -> mode == O_RDWR);
+            if(i >= 0)
+                io61_pin(f, i);
+            pthread_mutex_unlock(&f -> shard -> lock);
+        }
+        if(i < 0)
+            return nwritten ? (ssize_t) nwritten : FAIL;
+
+        size_t off = f -> pos - block;
+        size_t n = BUFSIZE - off;
+        if(n > sz - nwritten)
+            n = sz - nwritten;
+
+        // a range that neither touches nor overlaps the dirty one forces a write-back
+        if(cache[i].dirtylo < cache[i].dirtyhi
+           && (off > cache[i].dirtyhi || off + n < cache[i].dirtylo))
+        {
+            if(io61_writeback(i) == FAIL)
+                return nwritten ? (ssize_t) nwritten : FAIL;
+        }
+
+        memcpy(&cache[i].data[off], buf + nwritten, n);
+        io61_markdirty(i, off, n);
+        if(hit)
+            f -> stats.hitbytes += n;
+
+        nwritten += n;
+        f -> pos += n;
+    }
+
+    return nwritten;
+}
+
+/**
+ * [io61_markdirty adds bytes [off, off + n) of block slot `i` to its dirty range, which they
+ *                 must touch or overlap]
+ * @param i   [index of cache slot]
+ * @param off [offset in the block]
+ * @param n   [number of bytes]
+ */
+void io61_markdirty(int i, size_t off, size_t n)
+{
+    if(cache[i].dirtylo == cache[i].dirtyhi)
+    {
+        cache[i].dirtylo = off;
+        cache[i].dirtyhi = off + n;
+        cache[i].address -> ndirty++;
+        __atomic_fetch_add(&ndirty, 1, __ATOMIC_RELAXED);
+    }else
+    {
+        if(off < cache[i].dirtylo)
+            cache[i].dirtylo = off;
+        if(off + n > cache[i].dirtyhi)
+            cache[i].dirtyhi = off + n;
+    }
+    if(off + n > cache[i].bufsize)
+        cache[i].bufsize = off + n;
 }
 
 /**
@@ -320,195 +1221,5628 @@ ssize_t io61_write_mmap(io61_file* f, const char* buf, size_t sz) {
  */
 int io61_seek(io61_file* f, size_t pos) {
 
-    off_t r = lseek(f->fd, (off_t) pos, SEEK_SET);
-    f -> seq = FALSE;
+    f -> stats.seeks++;
+    f -> rectail = 0;
+
+    // compressed streams seek through their frame index
+    if(f -> zip)
+        return io61_zip_seek(f, pos);
 
-    if (r == (off_t) pos)
+    // read-ahead and write-behind only make sense for sequential streams
+    if(f -> async)
     {
-        f -> pos = r;
+        io61_async_flush(f);
+        io61_async_stop(f);
+    }
+
+    // io_uring requests carry their own offsets, so seeking costs no system call
+    if(f -> uring)
+    {
+        f -> pos = pos;
         return 0;
     }
-    else
+
+    // random access files use pread/pwrite through the block cache
+    if(f -> seq == FALSE)
+    {
+        f -> pos = pos;
+        return 0;
+    }
+
+    // leaving sequential mode: pending output goes out at the old position,
+    // read-ahead is dropped
+    if(f -> mode != O_RDONLY && io61_flush(f) == FAIL)
+        return -1;
+
+    long long start = io61_clock();
+    off_t r = lseek(f->fd, (off_t) pos, SEEK_SET);
+    io61_count(f, SYS_LSEEK, start, r == (off_t) -1 ? FAIL : 0);
+    if (r != (off_t) pos)
         return -1;
+
+    if(f -> slot >= 0)
+        io61_putslot(f -> slot);
+
+    // checksums follow the stream in order only; a writer's sidecar, probably left by an
+    // earlier version of the file, must not outlive the rewrite
+    if(f -> crcpath && f -> mode != O_RDONLY)
+        unlink(f -> crcpath);
+    free(f -> crcpath);
+    f -> crcpath = NULL;
+    f -> seq = FALSE;
+    f -> crc = FALSE;
+    f -> pos = r;
+    return 0;
 }
 
 
 /**
- * [io61_getslot description]
+ * [io61_getslot claims a cache slot as the stream buffer of the sequential file `f`]
  * @param  f [file]
- * @return   [index of cache slot]
+ * @return   [index of cache slot; -1 with errno ENOMEM if none could be claimed]
  */
 int io61_getslot(io61_file* f)
 {
-    if(cacheready == 0)
-    {
-        io61_cacheinit();
-        cacheready = 1;
-    }
-
-    // looking for unused slots:
-    for(int i = 0; i < NUMBEROFSLOTS; i++)
-    {
-        if(cache[i].address == NULL)
-        {    
-            cache[i].address = f;
-
-            if(f -> seq == FALSE && f -> mode == O_WRONLY)
-                cache[i].data = malloc( sizeof(void*) );
-            else
-                cache[i].data = malloc(BUFSIZE);
-
-            cache[i].offset = 0;
-            cache[i].bufsize = BUFSIZE;
-            
-            return i;
-        }
-    }
-
-    // no free slots. Evicting:
-    int i = io61_evict();
-
-    // the last rites:   
+    int i = io61_claimslot(f);
+    if(i < 0)
+        return FAIL;
     cache[i].address = f;
-    if(f -> seq == FALSE && f -> mode == O_WRONLY)
-        cache[i].data = malloc( sizeof(void*) );
-    else
-        cache[i].data = malloc(BUFSIZE);
+    io61_fileadd(f, cache[i].cap);
+    cache[i].queue = Q_STREAM;
     cache[i].offset = 0;
-    cache[i].bufsize = BUFSIZE;
-   
-    // ready to leave now
+    io61_streambuf(f, i);
+    cache[i].bufsize = f -> bufcap;
+    f -> slot = i;
+
     return i;
 }
 
 /**
- * [io61_evict applying evicting policy to cache slots]
- * @return  [index of freed cache slot]
+ * [io61_bufinit picks the first stream buffer size of the new file `f`. IO61_BUFSIZE=<bytes>,
+ *               with an optional k or m suffix, fixes it for every file. Otherwise it starts at
+ *               the preferred I/O size of the file (st_blksize), and a regular file gets
+ *               larger buffers, up to INITBUFMAX, as long as it holds 128 of them; io61_tune
+ *               goes on from there.]
+ * @param f [file]
  */
-int io61_evict(void)
+void io61_bufinit(io61_file* f)
 {
-    int i = toevict;
-    if( (cache[i].address) -> fd == O_WRONLY)
-        io61_flush(cache[toevict].address);
+    f -> bufcap = BUFSIZE;
+    f -> tuning = TRUE;
+    f -> tunecalls = 0;
+    f -> tunens = 0;
+    f -> tunerate = 0;
 
-    free(cache[i].data);
+    size_t size = io61_parsesize(getenv("IO61_BUFSIZE"));
+    if(size > 0)
+    {
+        f -> bufcap = io61_bufround(size);
+        f -> tuning = FALSE;
+        return;
+    }
 
-    toevict++;
-    toevict %= NUMBEROFSLOTS;
+    struct stat st;
+    if(fstat(f -> fd, &st) != 0)
+        return;
+    while(f -> bufcap < (size_t) st.st_blksize && f -> bufcap < INITBUFMAX)
+        f -> bufcap *= 2;
+    if(S_ISREG(st.st_mode))
+        while(f -> bufcap < INITBUFMAX && (off_t) f -> bufcap * 128 <= st.st_size)
+            f -> bufcap *= 2;
+}
 
-    return i;
+/**
+ * [io61_parsesize reads a size from the environment: a number of bytes, with an optional
+ *                 k, m or g suffix]
+ * @param  s [string, or NULL]
+ * @return   [bytes, 0 if `s` is NULL or not a size]
+ */
+size_t io61_parsesize(const char* s)
+{
+    if(s == NULL)
+        return 0;
+    char* end;
+    size_t size = strtoul(s, &end, 10);
+    if(*end == 'k' || *end == 'K')
+        size <<= 10;
+    else if(*end == 'm' || *end == 'M')
+        size <<= 20;
+    else if(*end == 'g' || *end == 'G')
+        size <<= 30;
+    return size;
 }
 
+/**
+ * [io61_bufround rounds a requested stream buffer size up to whole pages, within
+ *                [PAGESIZE, MAXBUFSIZE]]
+ * @param  size [bytes]
+ * @return      [buffer size]
+ */
+size_t io61_bufround(size_t size)
+{
+    if(size > MAXBUFSIZE)
+        return MAXBUFSIZE;
+    if(size < PAGESIZE)
+        return PAGESIZE;
+    return (size + PAGESIZE - 1) & ~((size_t) PAGESIZE - 1);
+}
 
 /**
- * [io61_cacheinit initializng cache slots]
+ * [io61_streambuf makes the buffer of stream slot `i` hold at least `f -> bufcap` bytes. A
+ *                 larger buffer is mapped on its own, with the old contents copied over;
+ *                 the pool only hands out BUFSIZE buffers.]
+ * @param f [file]
+ * @param i [index of cache slot]
  */
-void io61_cacheinit(void)
+void io61_streambuf(io61_file* f, int i)
 {
-    for(int i = 0; i < NUMBEROFSLOTS; i++)
+    if(cache[i].cap >= f -> bufcap)
+        return;
+
+    char* data = MAP_FAILED;
+    if(!io61_overbudget(f, f -> bufcap - cache[i].cap))
+        data = mmap(NULL, f -> bufcap, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(data == MAP_FAILED)
     {
-        cache[i].address = NULL;
-        cache[i].pos = INT_MAX;
+        // keep the buffer we have
+        f -> bufcap = cache[i].cap;
+        f -> tuning = FALSE;
+        return;
     }
+    memcpy(data, cache[i].data, cache[i].cap);
+    io61_memadd(f -> bufcap);
+    io61_fileadd(f, f -> bufcap - cache[i].cap);
+    if(cache[i].cap > BUFSIZE)
+    {
+        munmap(cache[i].data, cache[i].cap);
+        io61_memadd(-(ssize_t) cache[i].cap);
+    }else
+        io61_buffree(cache[i].data);
+    cache[i].data = data;
+    cache[i].cap = f -> bufcap;
 }
 
-
 /**
- * [io61_flush forces a write of any `f` buffers that contain data.]
- * @param  f [description]
- * @return   [description]
+ * [io61_tune adapts the stream buffer size of `f` to the system calls that fill and empty it.
+ *            Every TUNEROUND calls that moved a whole buffer, the time per byte is compared
+ *            with the previous round: while doubling the buffer saves at least 10% the buffer
+ *            keeps doubling, up to MAXBUFSIZE; otherwise it settles at the previous size.
+ *            Short reads and writes (a pipe that is not keeping up, the end of a file) say
+ *            nothing about the buffer, and requests of a whole buffer or more bypass it, so
+ *            neither counts. The new size takes effect when the buffer is next empty.]
+ * @param f  [file]
+ * @param n  [bytes the call moved]
+ * @param ns [its duration in nanoseconds]
  */
-int io61_flush(io61_file* f) {
-    //(void) f;
-    if(f -> mode == O_RDONLY)
-        return 0;
-
+void io61_tune(io61_file* f, size_t n, long long ns)
+{
+    if(f -> tuning == FALSE || n < f -> bufcap)
+        return;
+    f -> tunens += ns;
+    if(++f -> tunecalls < TUNEROUND)
+        return;
 
-    if( f -> seq == TRUE)
+    double rate = (double) f -> tunens / ((double) TUNEROUND * f -> bufcap);
+    f -> tunecalls = 0;
+    f -> tunens = 0;
+    if(f -> tunerate == 0 || rate < f -> tunerate * 0.9)
     {
-        // searching for a slot:
-        for(int i = 0; i < NUMBEROFSLOTS; i++)
-            if(cache[i].address == f)
-            {
-                if( write(f -> fd, cache[i].data, cache[i].offset) != -1)
-                {
-                    cache[i].address = NULL;           
-                    free(cache[i].address);
-                    return SUCCESS;
-                }else
-                    return FAIL;
-            }
-    }else    
+        f -> tunerate = rate;
+        if(f -> bufcap < MAXBUFSIZE)
+            f -> bufcap *= 2;
+        else
+            f -> tuning = FALSE;
+    }else
     {
-        /**
-         * file is non-sequential, and the cache slots may contain data in random order.
-         * We need to sort cache slots by 'pos' field in increasing order. 
-         */
-        if( io61_sortcache(f) == SUCCESS )
-
-        lseek(f -> fd, 0, SEEK_SET);
-        for(int i = 0; i < NUMBEROFSLOTS; i++)
-        {
-            if(cache[i].address == rw.inf)
-            {
-                write(f -> fd, cache[i].data, cache[i].bufsize);
-                munmap(cache[i].data, cache[i].bufsize);
-                //free(cache[i].data);
-            }
-        }
-
-        return SUCCESS;
+        f -> bufcap /= 2;
+        f -> tuning = FALSE;
     }
-
-    return FAIL;
 }
 
 /**
- * [io61_cachesort sorts the cache array by 'pos' field in increasing order. ]
- * @return [0 on success, -1 on fail]
+ * [io61_bufsize sets the stream buffer of `f` to `size` bytes, rounded up to whole pages and
+ *               limited to MAXBUFSIZE, and stops tuning it. Buffered output is flushed
+ *               first. Files read and written at random keep BUFSIZE blocks, and helper thread
+ *               and io_uring rings keep their own buffers.]
+ * @param  f    [file]
+ * @param  size [bytes; 0 only reports the current size]
+ * @return      [stream buffer size in bytes; -1 if the flush failed]
  */
-int io61_sortcache(io61_file* f)
+ssize_t io61_bufsize(io61_file* f, size_t size)
 {
-    (void) f;
-    // sorting cache array:
-    quicksort(0, NUMBEROFSLOTS);
+    if(size == 0)
+        return f -> bufcap;
 
-    return SUCCESS;
+    int i = f -> slot;
+    if(i >= 0 && f -> dir == O_WRONLY && io61_flush(f) == FAIL)
+        return FAIL;
+    f -> bufcap = io61_bufround(size);
+    f -> tuning = FALSE;
+    if(i >= 0 && f -> dir == O_WRONLY)
+    {
+        io61_streambuf(f, i);
+        cache[i].bufsize = f -> bufcap;
+    }
+    return f -> bufcap;
 }
 
-
 /**
- * [quicksort classic quick sort algorithm]
+ * [io61_meminit reads the memory limits from the environment (run once, through `memonce`):
+ *               IO61_MEMBUDGET bounds the buffers of the whole process and IO61_MEMQUOTA those
+ *               of each file, in bytes with an optional k, m or g suffix]
+ */
+void io61_meminit(void)
+{
+    membudget = io61_parsesize(getenv("IO61_MEMBUDGET"));
+    memquota = io61_parsesize(getenv("IO61_MEMQUOTA"));
+}
+
+/**
+ * [io61_memadd counts `bytes` more (or, negative, fewer) bytes of buffers handed out. Threads
+ *              count their buffers too, so the count and its peak are kept atomically.]
+ * @param bytes [change]
+ */
+void io61_memadd(ssize_t bytes)
+{
+    size_t used = __atomic_add_fetch(&memused, bytes, __ATOMIC_RELAXED);
+    size_t peak = __atomic_load_n(&mempeak, __ATOMIC_RELAXED);
+    while(used > peak && !__atomic_compare_exchange_n(&mempeak, &peak, used, TRUE,
+                                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+/**
+ * [io61_fileadd counts `bytes` more (or fewer) bytes of buffers held by `f`. Another thread
+ *               evicting a block of `f` counts it too, so the count is kept atomically.]
+ * @param f     [file]
+ * @param bytes [change]
+ */
+void io61_fileadd(io61_file* f, ssize_t bytes)
+{
+    size_t used = __atomic_add_fetch(&f -> memused, bytes, __ATOMIC_RELAXED);
+    unsigned long long peak = __atomic_load_n(&f -> stats.mempeak, __ATOMIC_RELAXED);
+    while(used > peak && !__atomic_compare_exchange_n(&f -> stats.mempeak, &peak, used, TRUE,
+                                                      __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+/**
+ * [io61_overbudget checks whether `more` bytes of new buffers would break the memory budget,
+ *                  or the quota of `f`]
+ * @param  f    [file that would hold them, NULL to check only the budget]
+ * @param  more [bytes]
+ * @return      [TRUE if they would]
+ */
+int io61_overbudget(io61_file* f, size_t more)
+{
+    if(membudget && __atomic_load_n(&memused, __ATOMIC_RELAXED) + more > membudget)
+        return TRUE;
+    return f && f -> memquota && __atomic_load_n(&f -> memused, __ATOMIC_RELAXED) + more > f -> memquota;
+}
+
+/**
+ * [io61_release gives the buffer of the unowned slot `i` back, so that it stops counting
+ *               against the budget. Pool buffers are returned to the pool with their pages
+ *               dropped.]
+ * @param i [index of cache slot]
+ */
+void io61_release(int i)
+{
+    if(cache[i].cap > BUFSIZE)
+    {
+        munmap(cache[i].data, cache[i].cap);
+        io61_memadd(-(ssize_t) cache[i].cap);
+    }else
+    {
+        madvise(cache[i].data, BUFSIZE, MADV_DONTNEED);
+        io61_buffree(cache[i].data);
+    }
+    cache[i].data = NULL;
+    cache[i].cap = 0;
+}
+
+/**
+ * [io61_memtrim brings the cache back within the memory budget: free slots give up their
+ *               buffers first, then the coldest clean blocks of each shard are released.
+ *               Dirty blocks go once their files write them back; stream buffers and rings
+ *               in use are left alone.]
+ */
+void io61_memtrim(void)
+{
+    pthread_once(&cacheonce, io61_cacheinit);
+
+    pthread_mutex_lock(&slotlock);
+    for(int i = freeslots; i >= 0 && io61_overbudget(NULL, 0); i = cache[i].next)
+        if(cache[i].data)
+            io61_release(i);
+    pthread_mutex_unlock(&slotlock);
+
+    for(int k = 0; k < NSHARDS && io61_overbudget(NULL, 0); k++)
+    {
+        cacheshard* sh = &shards[k];
+        pthread_mutex_lock(&sh -> lock);
+        while(sh -> ready && io61_overbudget(NULL, 0))
+        {
+            int i = io61_evict(sh, NULL, NULL);
+            if(i < 0)
+                break;
+            io61_release(i);
+            io61_freeslot(i);
+        }
+        pthread_mutex_unlock(&sh -> lock);
+    }
+}
+
+/**
+ * [io61_mem_budget limits the bytes all io61 buffers may take up. Once the limit is reached,
+ *                  new blocks reuse the buffers of cold ones, written back first when dirty,
+ *                  and stream buffers stop growing; lowering the limit trims the clean blocks
+ *                  at once. Each open stream keeps at least one buffer whatever the budget.]
+ * @param  bytes [new budget, 0 for no limit]
+ * @return       [previous budget]
+ */
+size_t io61_mem_budget(size_t bytes)
+{
+    pthread_once(&memonce, io61_meminit);
+    size_t old = membudget;
+    membudget = bytes;
+    io61_memtrim();
+    return old;
+}
+
+/**
+ * [io61_mem_quota limits the bytes of buffers `f` may hold. A file at its quota recycles its
+ *                 own coldest blocks instead of taking new ones.]
+ * @param  f     [file]
+ * @param  bytes [new quota, 0 for no limit]
+ * @return       [previous quota]
+ */
+size_t io61_mem_quota(io61_file* f, size_t bytes)
+{
+    size_t old = f -> memquota;
+    f -> memquota = bytes;
+    pthread_mutex_lock(&f -> shard -> lock);
+    while(bytes && f -> memused > bytes)
+    {
+        int i = io61_evict(f -> shard, f, f);
+        if(i < 0)
+            break;
+        io61_freeslot(i);
+    }
+    pthread_mutex_unlock(&f -> shard -> lock);
+    return old;
+}
+
+/**
+ * [io61_mem_used reports the bytes of buffers held by `f`, or by the whole process]
+ * @param  f [file, NULL for the process]
+ * @return   [bytes]
+ */
+size_t io61_mem_used(io61_file* f)
+{
+    return f ? f -> memused : memused;
+}
+
+/**
+ * [io61_putslot returns slot `i` to the free list. Its data buffer is kept for reuse, unless
+ *               it is a large stream buffer: blocks use BUFSIZE. Block slots should have been
+ *               written back, and their shard must be locked.]
+ * @param i [index of cache slot]
+ */
+void io61_putslot(int i)
+{
+    if(cache[i].address)
+        io61_fileadd(cache[i].address, -(ssize_t) cache[i].cap);
+    if(cache[i].queue != Q_STREAM && cache[i].dirtylo < cache[i].dirtyhi)
+    {
+        // a block whose write-back failed, dropped as its file closes
+        cache[i].address -> ndirty--;
+        __atomic_fetch_sub(&ndirty, 1, __ATOMIC_RELAXED);
+        cache[i].dirtylo = cache[i].dirtyhi = 0;
+    }
+    if(cache[i].cap > BUFSIZE)
+        io61_release(i);
+    if(cache[i].queue == Q_STREAM)
+        cache[i].address -> slot = -1;
+    else if(cache[i].queue != Q_FREE)
+    {
+        io61_dequeue(i);
+        io61_unhash(i);
+    }
+
+    cache[i].address = NULL;
+    cache[i].queue = Q_FREE;
+    cache[i].pinned = FALSE;
+    io61_freeslot(i);
+}
+
+/**
+ * [io61_freeslot puts the unowned slot `i` on the free list]
+ * @param i [index of cache slot]
+ */
+void io61_freeslot(int i)
+{
+    pthread_mutex_lock(&slotlock);
+    cache[i].next = freeslots;
+    freeslots = i;
+    pthread_mutex_unlock(&slotlock);
+}
+
+/**
+ * [io61_victim finds the block queue `q` gives up first: its tail, passing over blocks that
+ *              are lent out, dirty blocks of files other than `self` (each file is used by
+ *              one thread, which alone may write its blocks back), dirty blocks that already
+ *              failed to be written back and, with an `owner`, blocks of other files]
+ * @param  q     [A1in or Am]
+ * @param  owner [file whose block must go, NULL for any file]
+ * @param  self  [file of the calling thread, NULL for none]
+ * @return       [index of cache slot, -1 if there is none]
+ */
+int io61_victim(slotqueue* q, io61_file* owner, io61_file* self)
+{
+    int i = q -> tail;
+    while(i >= 0 && (cache[i].pinned || (owner && cache[i].address != owner)
+                     || (cache[i].dirtylo < cache[i].dirtyhi
+                         && (cache[i].address != self || cache[i].address -> err))))
+        i = cache[i].prev;
+    return i;
+}
+
+/**
+ * [io61_evict picks a victim block of shard `sh` with the 2Q policy, writes it back if it is
+ *             dirty and detaches it. A1in gives up its oldest block while it is over KIN
+ *             (remembering the key as a ghost), otherwise Am gives up its least recently
+ *             used one. With an `owner`, the victim is the coldest block of that file, from
+ *             A1in first. Stream buffers and lent blocks are never evicted. A block that
+ *             cannot be written back stays cached, dirty, and its file remembers the error
+ *             for its next write, flush or close; another victim is picked. Only the dirty
+ *             blocks of `self` may go: the durable, crc and O_DIRECT state of a file is
+ *             touched by its own thread alone.]
+ * @param  sh    [locked shard]
+ * @param  owner [file whose block must go, NULL for any file]
+ * @param  self  [file of the calling thread, NULL to take clean blocks only]
+ * @return       [index of freed cache slot, -1 if there is no block to evict]
+ */
+int io61_evict(cacheshard* sh, io61_file* owner, io61_file* self)
+{
+    int i;
+    do
+    {
+        if(owner || (sh -> a1in.size > 0 && (sh -> a1in.size > KIN || sh -> am.size == 0)))
+        {
+            i = io61_victim(&sh -> a1in, owner, self);
+            if(i < 0)
+                i = io61_victim(&sh -> am, owner, self);
+        }else
+        {
+            i = io61_victim(&sh -> am, owner, self);
+            if(i < 0)
+                i = io61_victim(&sh -> a1in, owner, self);
+        }
+        if(i < 0)
+            return FAIL;
+        if(io61_writeback(i) == FAIL)
+            cache[i].address -> err = errno ? errno : EIO;
+    }while(cache[i].dirtylo < cache[i].dirtyhi);
+
+    if(cache[i].queue == Q_A1IN)
+        io61_addghost(sh, cache[i].address, cache[i].pos);
+    __atomic_fetch_add(&cache[i].address -> stats.evictions, 1, __ATOMIC_RELAXED);
+    io61_fileadd(cache[i].address, -(ssize_t) cache[i].cap);
+
+    io61_dequeue(i);
+    io61_unhash(i);
+    cache[i].address = NULL;
+    cache[i].queue = Q_FREE;
+
+    return i;
+}
+
+
+/**
+ * [io61_cacheinit initializng cache slots and shard locks (run once, through `cacheonce`)]
+ */
+void io61_cacheinit(void)
+{
+    freeslots = -1;
+    for(int i = NUMBEROFSLOTS - 1; i >= 0; i--)
+    {
+        cache[i].address = NULL;
+        cache[i].data = NULL;
+        cache[i].cap = 0;
+        cache[i].pos = INT_MAX;
+        cache[i].queue = Q_FREE;
+        cache[i].pinned = FALSE;
+        cache[i].next = freeslots;
+        freeslots = i;
+    }
+    for(int k = 0; k < NSHARDS; k++)
+    {
+        pthread_mutex_init(&shards[k].lock, NULL);
+        shards[k].ready = FALSE;
+    }
+}
+
+/**
+ * [io61_shardfor picks the shard of a new file, in turn, and initializes its tables the first
+ *                time it is used]
+ * @return  [shard]
+ */
+cacheshard* io61_shardfor(void)
+{
+    pthread_once(&cacheonce, io61_cacheinit);
+    cacheshard* sh = &shards[__atomic_fetch_add(&nextshard, 1, __ATOMIC_RELAXED) % NSHARDS];
+
+    pthread_mutex_lock(&sh -> lock);
+    if(sh -> ready == FALSE)
+    {
+        for(int h = 0; h < HASHSIZE; h++)
+            sh -> hashtable[h] = sh -> ghosthash[h] = -1;
+        for(int g = 0; g < KOUT; g++)
+            sh -> ghosts[g].address = NULL;
+        sh -> ghostnext = 0;
+        sh -> a1in.head = sh -> a1in.tail = sh -> am.head = sh -> am.tail = -1;
+        sh -> a1in.size = sh -> am.size = 0;
+        sh -> ready = TRUE;
+    }
+    pthread_mutex_unlock(&sh -> lock);
+
+    return sh;
+}
+
+/**
+ * [io61_bufalloc hands out one BUFSIZE buffer from the pool in O(1). The pool is a single
+ *                anonymous mapping, aligned to a huge page and marked for transparent huge
+ *                pages, so buffers are page-aligned (usable with O_DIRECT) and cost no malloc.
+ *                Pages are only touched once their buffer is used, so a small job stays small.]
+ * @return  [page-aligned buffer, or NULL if the pool is used up and malloc fails]
+ */
+char* io61_bufalloc(void)
+{
+    io61_memadd(BUFSIZE);
+    pthread_mutex_lock(&poollock);
+    if(bufpool == NULL)
+    {
+        size_t size = (size_t) POOLBUFS * BUFSIZE + HUGEPAGESIZE;
+        char* map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(map != MAP_FAILED)
+        {
+            bufpool = (char*) (((unsigned long) map + HUGEPAGESIZE - 1) & ~((unsigned long) HUGEPAGESIZE - 1));
+#ifdef MADV_HUGEPAGE
+            madvise(bufpool, (size_t) POOLBUFS * BUFSIZE, MADV_HUGEPAGE);
+#endif
+        }
+    }
+
+    char* b = poolfree;
+    if(b)
+        poolfree = *(char**) b;
+    else if(bufpool && poolnext < POOLBUFS)
+        b = bufpool + BUFSIZE * poolnext++;
+    pthread_mutex_unlock(&poollock);
+    if(b)
+        return b;
+
+    // pool exhausted (many async rings): fall back to the allocator
+    void* p = NULL;
+    if(posix_memalign(&p, PAGESIZE, BUFSIZE) != 0)
+    {
+        io61_memadd(-(ssize_t) BUFSIZE);
+        return NULL;
+    }
+    return (char*) p;
+}
+
+/**
+ * [io61_buffree returns a buffer obtained from io61_bufalloc]
+ * @param b [buffer]
+ */
+void io61_buffree(char* b)
+{
+    io61_memadd(-(ssize_t) BUFSIZE);
+    if(bufpool && b >= bufpool && b < bufpool + (size_t) POOLBUFS * BUFSIZE)
+    {
+        pthread_mutex_lock(&poollock);
+        *(char**) b = poolfree;
+        poolfree = b;
+        pthread_mutex_unlock(&poollock);
+    }else
+        free(b);
+}
+
+/**
+ * [io61_hash bucket of block `pos` of file `f` in the tables of its shard]
+ * @param  f   [file]
+ * @param  pos [block-aligned file position]
+ * @return     [index into hashtable or ghosthash]
+ */
+unsigned io61_hash(io61_file* f, off_t pos)
+{
+    unsigned long h = (unsigned long) f / sizeof(io61_file) * 2654435761UL + (unsigned long) (pos / BUFSIZE);
+    h ^= h >> 15;
+    return (unsigned) (h * 2246822519UL) & (HASHSIZE - 1);
+}
+
+/**
+ * [io61_findblock finds block `pos` of `f` in the cache without recording a reference]
+ * @param  f   [file; its shard is locked]
+ * @param  pos [block-aligned file position]
+ * @return     [index of cache slot, or -1 if the block is not cached]
+ */
+int io61_findblock(io61_file* f, off_t pos)
+{
+    for(int i = f -> shard -> hashtable[io61_hash(f, pos)]; i >= 0; i = cache[i].hnext)
+        if(cache[i].address == f && cache[i].pos == pos)
+            return i;
+
+    return -1;
+}
+
+/**
+ * [io61_lookup finds block `pos` of `f` in the cache and records the reference:
+ *              a hit in Am moves the block to the front, a hit in A1in does nothing]
+ * @param  f   [file; its shard is locked]
+ * @param  pos [block-aligned file position]
+ * @return     [index of cache slot, or -1 on a miss]
+ */
+int io61_lookup(io61_file* f, off_t pos)
+{
+    slotqueue* am = &f -> shard -> am;
+    int i = io61_findblock(f, pos);
+    if(i >= 0 && cache[i].queue == Q_AM && am -> head != i)
+    {
+        io61_dequeue(i);
+        io61_enqueue(am, i, Q_AM);
+    }
+    return i;
+}
+
+/**
+ * [io61_pin lends block slot `i` to the application until the next io61_pin for `f`: it is
+ *           not evicted meanwhile, even by other threads]
+ * @param f [file; its shard is locked]
+ * @param i [index of cache slot of a block of `f`]
+ */
+void io61_pin(io61_file* f, int i)
+{
+    if(f -> pinslot >= 0 && cache[f -> pinslot].address == f)
+        cache[f -> pinslot].pinned = FALSE;
+    cache[i].pinned = TRUE;
+    f -> pinslot = i;
+}
+
+/**
+ * [io61_dirtyfull tells whether so much of the cache is dirty that files with dirty blocks
+ *                 must recycle their own: the other files can only take clean ones]
+ * @return [TRUE or FALSE]
+ */
+int io61_dirtyfull(void)
+{
+    size_t n = __atomic_load_n(&ndirty, __ATOMIC_RELAXED);
+    return n >= DIRTYMAX || (membudget && n * BUFSIZE >= membudget / 2);
+}
+
+/**
+ * [io61_claimslot takes a cache slot for `f` and gives it a buffer. A file over its quota,
+ *                 or with dirty blocks while too much of the cache is dirty, gives up its own
+ *                 coldest block; otherwise a free slot is taken, as long as
+ *                 its buffer exists or fits in the memory budget, and a block is evicted
+ *                 when none is, from the shard of `f` first and then from the others. Only
+ *                 when every other slot is a stream buffer or lent does the cache grow past
+ *                 the budget. The slot belongs to no file and no queue until the caller
+ *                 attaches it. No shard may be locked by the caller: shards are locked one
+ *                 at a time here.]
+ * @param  f [file the slot is for]
+ * @return   [index of cache slot; -1 with errno ENOMEM if every slot is lent out or a stream
+ *            buffer, or no buffer could be allocated]
+ */
+int io61_claimslot(io61_file* f)
+{
+    int i = -1;
+    if((f -> memquota && f -> memused + BUFSIZE > f -> memquota) || (f -> ndirty && io61_dirtyfull()))
+    {
+        pthread_mutex_lock(&f -> shard -> lock);
+        i = io61_evict(f -> shard, f, f);
+        pthread_mutex_unlock(&f -> shard -> lock);
+    }
+    if(i < 0)
+    {
+        pthread_mutex_lock(&slotlock);
+        if(freeslots >= 0 && (cache[freeslots].data || !io61_overbudget(NULL, BUFSIZE)))
+        {
+            i = freeslots;
+            freeslots = cache[i].next;
+        }
+        pthread_mutex_unlock(&slotlock);
+    }
+    for(int k = 0; i < 0 && k < NSHARDS; k++)
+    {
+        cacheshard* sh = &shards[(f -> shard - shards + k) % NSHARDS];
+        pthread_mutex_lock(&sh -> lock);
+        if(sh -> ready)
+            i = io61_evict(sh, NULL, f);
+        pthread_mutex_unlock(&sh -> lock);
+    }
+    if(i < 0)
+    {
+        pthread_mutex_lock(&slotlock);
+        i = freeslots;
+        if(i >= 0)
+            freeslots = cache[i].next;
+        pthread_mutex_unlock(&slotlock);
+    }
+    if(i < 0)
+    {
+        errno = ENOMEM;
+        return FAIL;
+    }
+
+    cache[i].pinned = FALSE;
+    if(cache[i].data == NULL)
+    {
+        cache[i].data = io61_bufalloc();
+        if(cache[i].data == NULL)
+        {
+            io61_freeslot(i);
+            errno = ENOMEM;
+            return FAIL;
+        }
+        cache[i].cap = BUFSIZE;
+    }
+    return i;
+}
+
+/**
+ * [io61_insertblock makes claimed slot `i` block `pos` of `f`. Keys found among the ghosts
+ *                   were evicted from A1in recently and go straight to Am.]
+ * @param f   [file; its shard is locked]
+ * @param i   [index of cache slot; its `bufsize` and dirty range must be set]
+ * @param pos [block-aligned file position]
+ */
+void io61_insertblock(io61_file* f, int i, off_t pos)
+{
+    cacheshard* sh = f -> shard;
+    cache[i].address = f;
+    cache[i].pos = pos;
+    io61_fileadd(f, cache[i].cap);
+
+    unsigned h = io61_hash(f, pos);
+    cache[i].hnext = sh -> hashtable[h];
+    sh -> hashtable[h] = i;
+    if(io61_isghost(f, pos))
+        io61_enqueue(&sh -> am, i, Q_AM);
+    else
+        io61_enqueue(&sh -> a1in, i, Q_A1IN);
+}
+
+/**
+ * [io61_loadblock brings block `pos` of `f` into the cache. The shard of `f` is unlocked
+ *                 while a slot is claimed and read: only the thread using `f` adds blocks
+ *                 of `f`, so nobody else can bring the same block in meanwhile.]
+ * @param  f    [file; its shard is locked, and is again on return]
+ * @param  pos  [block-aligned file position]
+ * @param  fill [TRUE to read the block from the file, FALSE to start with an empty block]
+ * @return      [index of cache slot, or -1 if no slot could be claimed or the block could
+ *               not be read]
+ */
+int io61_loadblock(io61_file* f, off_t pos, int fill)
+{
+    pthread_mutex_unlock(&f -> shard -> lock);
+    int i = io61_claimslot(f);
+    if(i < 0)
+    {
+        pthread_mutex_lock(&f -> shard -> lock);
+        return FAIL;
+    }
+    cache[i].bufsize = 0;
+    cache[i].dirtylo = cache[i].dirtyhi = 0;
+    f -> stats.misses++;
+
+    if(fill)
+    {
+        ssize_t n;
+        do
+        {
+            long long start = io61_clock();
+            n = pread(f -> fd, cache[i].data, BUFSIZE, pos);
+            io61_count(f, SYS_PREAD, start, n);
+        }while(n == -1 && errno == EINTR);
+        if(n < 0)
+        {
+            io61_freeslot(i);
+            pthread_mutex_lock(&f -> shard -> lock);
+            return FAIL;
+        }
+        cache[i].bufsize = n;
+    }
+
+    pthread_mutex_lock(&f -> shard -> lock);
+    io61_insertblock(f, i, pos);
+    return i;
+}
+
+/**
+ * [io61_readbehind brings block `pos` of `f` into the cache after a read missed it. A miss
+ *                  on the block just below the previous one is a backward scan (reverse61
+ *                  seeks back before every byte): then the window of uncached blocks ending
+ *                  at `pos` comes in with one preadv. The window doubles, up to READBEHIND
+ *                  blocks, while the scan goes on, so reading a file backwards costs one
+ *                  system call per window; any other miss loads just the one block.]
+ * @param  f   [file; its shard is locked, and is again on return]
+ * @param  pos [block-aligned file position]
+ * @return     [index of the cache slot of block `pos`, or -1 if it could not be read]
+ */
+int io61_readbehind(io61_file* f, off_t pos)
+{
+    if(pos + BUFSIZE != f -> lastmiss)
+        f -> behind = 1;
+    else if(f -> behind < READBEHIND)
+        f -> behind *= 2;
+
+    // the window stops at the start of the file and at blocks that are already cached
+    int n = 1;
+    while(n < f -> behind && pos >= (off_t) n * BUFSIZE
+          && io61_findblock(f, pos - (off_t) n * BUFSIZE) < 0)
+        n++;
+    off_t first = pos - (off_t) (n - 1) * BUFSIZE;
+    f -> lastmiss = first;
+    if(n == 1)
+        return io61_loadblock(f, pos, TRUE);
+
+    pthread_mutex_unlock(&f -> shard -> lock);
+    int slots[READBEHIND];
+    struct iovec iov[READBEHIND];
+    for(int k = 0; k < n; k++)
+    {
+        slots[k] = io61_claimslot(f);
+        if(slots[k] < 0)
+        {
+            // too few slots for the window: give them back and load just the one block
+            while(k-- > 0)
+                io61_freeslot(slots[k]);
+            pthread_mutex_lock(&f -> shard -> lock);
+            return io61_loadblock(f, pos, TRUE);
+        }
+        iov[k].iov_base = cache[ slots[k] ].data;
+        iov[k].iov_len = BUFSIZE;
+    }
+    f -> stats.misses++;
+
+    ssize_t r;
+    do
+    {
+        long long start = io61_clock();
+        r = preadv(f -> fd, iov, n, first);
+        io61_count(f, SYS_PREAD, start, r);
+    }while(r == -1 && errno == EINTR);
+    if(r < 0)
+    {
+        for(int k = 0; k < n; k++)
+            io61_freeslot(slots[k]);
+        pthread_mutex_lock(&f -> shard -> lock);
+        return FAIL;
+    }
+
+    // block `pos` is read first, so it enters the queues first and the blocks below it,
+    // which the scan reaches later, are the youngest; blocks evicted meanwhile simply
+    // come back
+    pthread_mutex_lock(&f -> shard -> lock);
+    for(int k = n - 1; k >= 0; k--)
+    {
+        int i = slots[k];
+        ssize_t left = r - (ssize_t) k * BUFSIZE;
+        cache[i].bufsize = left <= 0 ? 0 : (left < BUFSIZE ? (size_t) left : BUFSIZE);
+        cache[i].dirtylo = cache[i].dirtyhi = 0;
+        io61_insertblock(f, i, first + (off_t) k * BUFSIZE);
+    }
+    return slots[n - 1];
+}
+
+/**
+ * [io61_writeback writes the dirty range of block slot `i` to its file]
+ * @param  i [index of cache slot]
+ * @return   [0 on success, -1 on failure]
+ */
+int io61_writeback(int i)
+{
+    cacheslot* c = &cache[i];
+    if(c -> dirtylo == c -> dirtyhi)
+        return SUCCESS;
+
+    int r;
+    if(c -> address -> direct)
+        r = io61_pwrite_direct(c -> address, &c -> data[c -> dirtylo],
+                               c -> dirtyhi - c -> dirtylo, c -> pos + c -> dirtylo);
+    else
+        r = io61_pwrite_all(c -> address, &c -> data[c -> dirtylo],
+                            c -> dirtyhi - c -> dirtylo, c -> pos + c -> dirtylo);
+    if(r == FAIL)
+        return FAIL;
+    c -> dirtylo = c -> dirtyhi = 0;
+    c -> address -> ndirty--;
+    __atomic_fetch_sub(&ndirty, 1, __ATOMIC_RELAXED);
+
+    return SUCCESS;
+}
+
+/**
+ * [io61_enqueue inserts slot `i` at the head of queue `q`]
+ * @param q     [A1in or Am]
+ * @param i     [index of cache slot]
+ * @param which [Q_A1IN or Q_AM]
+ */
+void io61_enqueue(slotqueue* q, int i, int which)
+{
+    cache[i].queue = which;
+    cache[i].prev = -1;
+    cache[i].next = q -> head;
+    if(q -> head >= 0)
+        cache[q -> head].prev = i;
+    else
+        q -> tail = i;
+    q -> head = i;
+    q -> size++;
+}
+
+/**
+ * [io61_dequeue unlinks slot `i` from its queue]
+ * @param i [index of cache slot]
+ */
+void io61_dequeue(int i)
+{
+    cacheshard* sh = cache[i].address -> shard;
+    slotqueue* q = cache[i].queue == Q_AM ? &sh -> am : &sh -> a1in;
+
+    if(cache[i].prev >= 0)
+        cache[cache[i].prev].next = cache[i].next;
+    else
+        q -> head = cache[i].next;
+    if(cache[i].next >= 0)
+        cache[cache[i].next].prev = cache[i].prev;
+    else
+        q -> tail = cache[i].prev;
+    q -> size--;
+}
+
+/**
+ * [io61_unhash removes slot `i` from its hash bucket]
+ * @param i [index of cache slot]
+ */
+void io61_unhash(int i)
+{
+    int* link = &cache[i].address -> shard -> hashtable[io61_hash(cache[i].address, cache[i].pos)];
+    while(*link != i)
+        link = &cache[*link].hnext;
+    *link = cache[i].hnext;
+}
+
+/**
+ * [io61_isghost checks whether block `pos` of `f` was evicted from A1in recently]
+ * @param  f   [file; its shard is locked]
+ * @param  pos [block-aligned file position]
+ * @return     [TRUE or FALSE]
+ */
+int io61_isghost(io61_file* f, off_t pos)
+{
+    cacheshard* sh = f -> shard;
+    for(int g = sh -> ghosthash[io61_hash(f, pos)]; g >= 0; g = sh -> ghosts[g].hnext)
+        if(sh -> ghosts[g].address == f && sh -> ghosts[g].pos == pos)
+            return TRUE;
+
+    return FALSE;
+}
+
+/**
+ * [io61_addghost remembers the key of a block evicted from A1in,
+ *                forgetting the oldest ghost of the shard once KOUT are stored]
+ * @param sh  [locked shard of `f`]
+ * @param f   [file]
+ * @param pos [block-aligned file position]
+ */
+void io61_addghost(cacheshard* sh, io61_file* f, off_t pos)
+{
+    int g = sh -> ghostnext;
+    sh -> ghostnext = (sh -> ghostnext + 1) % KOUT;
+
+    if(sh -> ghosts[g].address)
+        io61_unghost(sh, g);
+
+    unsigned h = io61_hash(f, pos);
+    sh -> ghosts[g].address = f;
+    sh -> ghosts[g].pos = pos;
+    sh -> ghosts[g].hnext = sh -> ghosthash[h];
+    sh -> ghosthash[h] = g;
+}
+
+/**
+ * [io61_unghost forgets ghost `g`]
+ * @param sh [locked shard]
+ * @param g  [index into its ghosts]
+ */
+void io61_unghost(cacheshard* sh, int g)
+{
+    int* link = &sh -> ghosthash[io61_hash(sh -> ghosts[g].address, sh -> ghosts[g].pos)];
+    while(*link != g)
+        link = &sh -> ghosts[*link].hnext;
+    *link = sh -> ghosts[g].hnext;
+    sh -> ghosts[g].address = NULL;
+}
+
+/**
+ * [io61_dropblocks removes every cached block and ghost of `f`, which is being closed.
+ *                  Dirty blocks must have been written back.]
+ * @param f [file]
+ */
+void io61_dropblocks(io61_file* f)
+{
+    cacheshard* sh = f -> shard;
+    pthread_mutex_lock(&sh -> lock);
+
+    slotqueue* queues[2] = {&sh -> a1in, &sh -> am};
+    for(int q = 0; q < 2; q++)
+        for(int i = queues[q] -> head, next; i >= 0; i = next)
+        {
+            next = cache[i].next;
+            if(cache[i].address == f)
+                io61_putslot(i);
+        }
+
+    // a later file may get the same address; its blocks must not look familiar
+    for(int g = 0; g < KOUT; g++)
+        if(sh -> ghosts[g].address == f)
+            io61_unghost(sh, g);
+
+    pthread_mutex_unlock(&sh -> lock);
+}
+
+/**
+ * [io61_flush forces a write of any `f` buffers that contain data. A durable file then
+ *             applies its group commit policy.]
+ * @param  f [file]
+ * @return   [0 on success, -1 if a write or a sync failed]
+ */
+int io61_flush(io61_file* f) {
+    int r = io61_flushdata(f);
+    if(r == SUCCESS && f -> durable)
+        r = io61_durablecheck(f);
+    if(r == SUCCESS && f -> err)
+    {
+        // a block of `f` could not be written back when it was evicted
+        errno = f -> err;
+        r = FAIL;
+    }
+    return r;
+}
+
+/**
+ * [io61_flushdata writes the buffers of `f` that contain data to the kernel]
+ * @param  f [file]
+ * @return   [0 on success, -1 on failure]
+ */
+int io61_flushdata(io61_file* f) {
+    //(void) f;
+    if(f -> zip)
+        return io61_zip_flush(f);
+    if(f -> async)
+        return io61_async_flush(f);
+#ifdef HAVE_URING
+    if(f -> uring)
+        return io61_uring_flush(f);
+#endif
+
+    if(f -> mode == O_RDONLY || (f -> seq == TRUE && f -> dir == O_RDONLY))
+        return 0;
+
+
+    if( f -> seq == TRUE)
+    {
+        int i = f -> slot;
+        if(i < 0 || cache[i].offset == f -> dclean)
+            return SUCCESS;     // nothing buffered
+        f -> stats.flushes++;
+
+        if(f -> direct)
+        {
+            // the buffer starts at `pos`; a partial last page is written through the page
+            // cache and kept, so the next flush rewrites it whole and stays aligned
+            size_t len = cache[i].offset;
+            if(io61_pwrite_direct(f, cache[i].data, len, f -> pos) == FAIL)
+                return FAIL;
+            f -> stats.hitbytes += len - f -> dclean;
+
+            size_t keep = (f -> pos + len) % PAGESIZE;
+            if(keep > len)
+                keep = len;
+            memmove(cache[i].data, &cache[i].data[len - keep], keep);
+            f -> pos += len - keep;
+            cache[i].offset = f -> dclean = keep;
+            return SUCCESS;
+        }
+
+        struct iovec iov;
+        iov.iov_base = cache[i].data;
+        iov.iov_len = cache[i].offset;
+        long long start = io61_clock();
+        if(io61_writev_all(f, &iov, 1) != (ssize_t) cache[i].offset)
+            return FAIL;
+        io61_tune(f, cache[i].offset, io61_clock() - start);
+
+        f -> stats.hitbytes += cache[i].offset;
+        cache[i].offset = 0;
+        io61_streambuf(f, i);
+        cache[i].bufsize = f -> bufcap;
+        f -> msgstamped = FALSE;
+        return SUCCESS;
+    }else    
+    {
+        /**
+         * file is non-sequential, and the cache slots may contain data in random order.
+         * Writing the dirty blocks back in increasing 'pos' order keeps the disk access sequential.
+         * The order is built in the shard's own array, which its lock covers.
+         */
+        int* slots = f -> shard -> sorted;
+        pthread_mutex_lock(&f -> shard -> lock);
+        int n = io61_sortcache(f, slots);
+        int r = SUCCESS;
+        if(n > 0)
+            f -> stats.flushes++;
+
+        for(int k = 0; k < n; k++)
+            if(io61_writeback(slots[k]) == FAIL)
+                r = FAIL;
+        pthread_mutex_unlock(&f -> shard -> lock);
+
+        return r;
+    }
+}
+
+/**
+ * [io61_sortcache collects the dirty blocks of `f`, sorted by 'pos' field in increasing order. ]
+ * @param  f     [file; its shard is locked]
+ * @param  slots [receives the slot indices; room for NUMBEROFSLOTS entries]
+ * @return       [number of slots found]
+ */
+int io61_sortcache(io61_file* f, int* slots)
+{
+    int n = 0;
+
+    slotqueue* queues[2] = {&f -> shard -> a1in, &f -> shard -> am};
+    for(int q = 0; q < 2; q++)
+        for(int i = queues[q] -> head; i >= 0; i = cache[i].next)
+            if(cache[i].address == f && cache[i].dirtylo < cache[i].dirtyhi)
+                slots[n++] = i;
+
+    if(n > 1)
+        quicksort(slots, 0, n - 1);
+
+    return n;
+}
+
+
+/**
+ * [quicksort classic quick sort algorithm, ordering slot indices by the 'pos' of their slots]
+ * @param slots [slot indices]
  * @param first [index of the first element in a scope]
  * @param last  [index of the last element inthe scope]
  */
-void quicksort(int first, int last)
+void quicksort(int* slots, int first, int last)
+{
+    int temp;
+    int i = first, 
+    j = last;
+    off_t x = cache[slots[(first + last) / 2]].pos;
+ 
+    do {
+        while (cache[slots[i]].pos < x) i++;
+        while (cache[slots[j]].pos > x) j--;
+ 
+        if(i <= j) {
+            if (i < j)
+            {
+                temp = slots[i];
+                slots[i] = slots[j];
+                slots[j] = temp;
+            } 
+            i++;
+            j--;
+        }
+    } while (i <= j);
+ 
+    if (i < last)
+        quicksort(slots, i, last);
+    if (first < j)
+        quicksort(slots, first, j);
+}
+
+/**
+ * [io61_async_start switches `f` to double- or multi-buffered mode: a helper thread
+ *                   reads ahead into (or writes behind from) a ring of `nbufs` buffers,
+ *                   so the application's CPU work overlaps with I/O.
+ *                   Must be called before any data is read from or written to `f`.]
+ * @param  f     [file]
+ * @param  nbufs [number of buffers in the ring, at least 2; 0 selects ASYNCBUFS]
+ * @return       [0 on success, -1 on failure (the file stays synchronous)]
+ */
+int io61_async_start(io61_file* f, int nbufs)
+{
+    if(f -> async)
+        return SUCCESS;
+    if(f -> zip)
+        return FAIL;
+    if(nbufs <= 0)
+        nbufs = ASYNCBUFS;
+    if(nbufs < 2)
+        nbufs = 2;
+    while(nbufs > 2 && io61_overbudget(f, nbufs * BUFSIZE))
+        nbufs--;
+
+    asyncring* ring = (asyncring*) malloc(sizeof(asyncring));
+    if(ring == NULL)
+    {
+        errno = ENOMEM;
+        return FAIL;
+    }
+    ring -> bufs = (asyncbuf*) malloc(nbufs * sizeof(asyncbuf));
+    int n = 0;
+    while(ring -> bufs && n < nbufs && (ring -> bufs[n].data = io61_bufalloc()) != NULL)
+    {
+        ring -> bufs[n].len = 0;
+        ring -> bufs[n].offset = 0;
+        n++;
+    }
+    if(n < 2)
+    {
+        // the file stays synchronous
+        while(n > 0)
+            io61_buffree(ring -> bufs[--n].data);
+        free(ring -> bufs);
+        free(ring);
+        errno = ENOMEM;
+        return FAIL;
+    }
+    // a shorter ring than asked for still works
+    nbufs = n;
+    ring -> nbufs = nbufs;
+    ring -> prod = ring -> cons = ring -> count = 0;
+    ring -> held = FALSE;
+    ring -> stop = FALSE;
+    ring -> error = 0;
+    pthread_mutex_init(&ring -> mutex, NULL);
+    pthread_cond_init(&ring -> produced, NULL);
+    pthread_cond_init(&ring -> consumed, NULL);
+
+    f -> async = ring;
+    if(pthread_create(&ring -> thread, NULL,
+                      f -> mode == O_RDONLY ? io61_async_reader : io61_async_writer, f) != 0)
+    {
+        f -> async = NULL;
+        for(int i = 0; i < nbufs; i++)
+            io61_buffree(ring -> bufs[i].data);
+        free(ring -> bufs);
+        free(ring);
+        return FAIL;
+    }
+    io61_fileadd(f, nbufs * BUFSIZE);
+
+    return SUCCESS;
+}
+
+/**
+ * [io61_async_reader helper thread body for readers. Fills free buffers with read(2)
+ *                    until end-of-file or an error, which is passed to the application
+ *                    as a buffer with `len` 0 or -1.
+ *                    Cancellation is only enabled around read(2), which may block forever
+ *                    on a pipe that is never written again.]
+ * @param  arg [io61_file*]
+ * @return     [NULL]
+ */
+void* io61_async_reader(void* arg)
+{
+    io61_file* f = (io61_file*) arg;
+    asyncring* ring = f -> async;
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+
+    while(1)
+    {
+        pthread_mutex_lock(&ring -> mutex);
+        while(ring -> count == ring -> nbufs && !ring -> stop)
+            pthread_cond_wait(&ring -> consumed, &ring -> mutex);
+        if(ring -> stop)
+        {
+            pthread_mutex_unlock(&ring -> mutex);
+            return NULL;
+        }
+        pthread_mutex_unlock(&ring -> mutex);
+
+        // the producer owns bufs[prod] as long as the ring is not full
+        asyncbuf* b = &ring -> bufs[ring -> prod];
+        ssize_t n;
+        pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+        do
+        {
+            long long start = io61_clock();
+            n = read(f -> fd, b -> data, BUFSIZE);
+            io61_count(f, SYS_READ, start, n);
+        }while(n == -1 && errno == EINTR);
+        pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+        io61_crcadd(f, O_RDONLY, b -> data, n);
+        b -> len = n;
+        b -> offset = 0;
+
+        pthread_mutex_lock(&ring -> mutex);
+        ring -> prod = (ring -> prod + 1) % ring -> nbufs;
+        ring -> count++;
+        pthread_cond_signal(&ring -> produced);
+        pthread_mutex_unlock(&ring -> mutex);
+
+        if(n <= 0)
+            return NULL;
+    }
+}
+
+/**
+ * [io61_async_writer helper thread body for writers. Writes out full buffers in order
+ *                    and hands them back to the application.]
+ * @param  arg [io61_file*]
+ * @return     [NULL]
+ */
+void* io61_async_writer(void* arg)
+{
+    io61_file* f = (io61_file*) arg;
+    asyncring* ring = f -> async;
+
+    while(1)
+    {
+        pthread_mutex_lock(&ring -> mutex);
+        while(ring -> count == 0 && !ring -> stop)
+            pthread_cond_wait(&ring -> produced, &ring -> mutex);
+        if(ring -> count == 0)
+        {
+            pthread_mutex_unlock(&ring -> mutex);
+            return NULL;
+        }
+        pthread_mutex_unlock(&ring -> mutex);
+
+        asyncbuf* b = &ring -> bufs[ring -> cons];
+        int error = 0;
+        while(b -> offset < (size_t) b -> len && !error)
+        {
+            long long start = io61_clock();
+            ssize_t n = write(f -> fd, b -> data + b -> offset, b -> len - b -> offset);
+            io61_count(f, SYS_WRITE, start, n);
+            io61_crcadd(f, O_WRONLY, b -> data + b -> offset, n);
+            if(n > 0)
+                b -> offset += n;
+            else if(n == -1 && errno != EINTR)
+                error = errno;
+        }
+        b -> len = 0;
+        b -> offset = 0;
+
+        pthread_mutex_lock(&ring -> mutex);
+        if(error && !ring -> error)
+            ring -> error = error;
+        ring -> cons = (ring -> cons + 1) % ring -> nbufs;
+        ring -> count--;
+        pthread_cond_signal(&ring -> consumed);
+        pthread_mutex_unlock(&ring -> mutex);
+    }
+}
+
+/**
+ * [io61_async_stop terminates the helper thread of `f` and frees the ring.
+ *                  Buffered write data must have been flushed; read-ahead data is dropped.]
+ * @param  f [file]
+ * @return   [0 on success, -1 if the helper thread reported a write error]
+ */
+int io61_async_stop(io61_file* f)
+{
+    asyncring* ring = f -> async;
+    if(ring == NULL)
+        return SUCCESS;
+
+    pthread_mutex_lock(&ring -> mutex);
+    ring -> stop = TRUE;
+    pthread_cond_broadcast(&ring -> produced);
+    pthread_cond_broadcast(&ring -> consumed);
+    pthread_mutex_unlock(&ring -> mutex);
+
+    if(f -> mode == O_RDONLY)
+        pthread_cancel(ring -> thread);
+    pthread_join(ring -> thread, NULL);
+
+    int r = ring -> error ? FAIL : SUCCESS;
+    for(int i = 0; i < ring -> nbufs; i++)
+        io61_buffree(ring -> bufs[i].data);
+    io61_fileadd(f, -(ssize_t) ring -> nbufs * BUFSIZE);
+    free(ring -> bufs);
+    pthread_mutex_destroy(&ring -> mutex);
+    pthread_cond_destroy(&ring -> produced);
+    pthread_cond_destroy(&ring -> consumed);
+    free(ring);
+    f -> async = NULL;
+
+    return r;
+}
+
+/**
+ * [io61_async_rdbuf returns the buffer the application is reading from,
+ *                   waiting for the helper thread if none is ready yet]
+ * @param  ring [ring of a read-only file]
+ * @return      [buffer with unread data, or the end-of-file/error buffer]
+ */
+asyncbuf* io61_async_rdbuf(asyncring* ring)
+{
+    asyncbuf* b = &ring -> bufs[ring -> cons];
+
+    // fast path: the current buffer still has data and belongs to us
+    if(ring -> held && b -> len > 0 && b -> offset < (size_t) b -> len)
+        return b;
+
+    pthread_mutex_lock(&ring -> mutex);
+    if(ring -> held && b -> len > 0)
+    {
+        // finished with this buffer, give it back to the helper thread
+        ring -> cons = (ring -> cons + 1) % ring -> nbufs;
+        ring -> count--;
+        ring -> held = FALSE;
+        pthread_cond_signal(&ring -> consumed);
+        b = &ring -> bufs[ring -> cons];
+    }
+    while(ring -> count == 0)
+        pthread_cond_wait(&ring -> produced, &ring -> mutex);
+    ring -> held = TRUE;
+    pthread_mutex_unlock(&ring -> mutex);
+
+    return b;
+}
+
+/**
+ * [io61_async_wrbuf returns the buffer the application is writing to,
+ *                   handing a full one to the helper thread first]
+ * @param  ring [ring of a write-only file]
+ * @return      [buffer with free space, or NULL if the helper thread reported an error]
+ */
+asyncbuf* io61_async_wrbuf(asyncring* ring)
+{
+    asyncbuf* b = &ring -> bufs[ring -> prod];
+
+    if(b -> len < BUFSIZE)
+        return b;
+
+    pthread_mutex_lock(&ring -> mutex);
+    ring -> prod = (ring -> prod + 1) % ring -> nbufs;
+    ring -> count++;
+    pthread_cond_signal(&ring -> produced);
+    while(ring -> count == ring -> nbufs)
+        pthread_cond_wait(&ring -> consumed, &ring -> mutex);
+    b = ring -> error ? NULL : &ring -> bufs[ring -> prod];
+    pthread_mutex_unlock(&ring -> mutex);
+
+    return b;
+}
+
+/**
+ * [io61_async_readc io61_readc for files in async mode]
+ * @param  f [file]
+ * @return   [character read, or EOF on error or end-of-file]
+ */
+int io61_async_readc(io61_file* f)
+{
+    asyncbuf* b = io61_async_rdbuf(f -> async);
+    if(b -> len <= 0)
+        return EOF;
+
+    return (unsigned char) b -> data[ b -> offset++ ];
+}
+
+/**
+ * [io61_async_read io61_read for files in async mode]
+ * @param  f   [file]
+ * @param  buf [destination]
+ * @param  sz  [number of bytes requested]
+ * @return     [number of bytes read; short only at end-of-file or on error;
+ *              -1 if an error occurred before any bytes were read]
+ */
+ssize_t io61_async_read(io61_file* f, char* buf, size_t sz)
+{
+    size_t nread = 0;
+
+    while(nread < sz)
+    {
+        asyncbuf* b = io61_async_rdbuf(f -> async);
+        if(b -> len <= 0)
+        {
+            if(b -> len < 0 && nread == 0)
+                return FAIL;
+            break;
+        }
+
+        size_t n = b -> len - b -> offset;
+        if(n > sz - nread)
+            n = sz - nread;
+        memcpy(buf + nread, b -> data + b -> offset, n);
+        b -> offset += n;
+        nread += n;
+    }
+
+    return nread;
+}
+
+/**
+ * [io61_async_writec io61_writec for files in async mode]
+ * @param  f  [file]
+ * @param  ch [character to write]
+ * @return    [0 on success, -1 if the helper thread reported an error]
+ */
+int io61_async_writec(io61_file* f, int ch)
+{
+    asyncbuf* b = io61_async_wrbuf(f -> async);
+    if(b == NULL)
+        return FAIL;
+
+    b -> data[ b -> len++ ] = ch;
+    return SUCCESS;
+}
+
+/**
+ * [io61_async_write io61_write for files in async mode]
+ * @param  f   [file]
+ * @param  buf [source]
+ * @param  sz  [number of bytes to write]
+ * @return     [number of bytes written, normally `sz`;
+ *              -1 if the helper thread reported an error before any bytes were written]
+ */
+ssize_t io61_async_write(io61_file* f, const char* buf, size_t sz)
+{
+    size_t nwritten = 0;
+
+    while(nwritten < sz)
+    {
+        asyncbuf* b = io61_async_wrbuf(f -> async);
+        if(b == NULL)
+            return nwritten ? (ssize_t) nwritten : FAIL;
+
+        size_t n = BUFSIZE - b -> len;
+        if(n > sz - nwritten)
+            n = sz - nwritten;
+        memcpy(b -> data + b -> len, buf + nwritten, n);
+        b -> len += n;
+        nwritten += n;
+    }
+
+    return nwritten;
+}
+
+/**
+ * [io61_async_flush hands the partially filled buffer to the helper thread
+ *                   and waits until every queued buffer has been written]
+ * @param  f [file]
+ * @return   [0 on success, -1 if the helper thread reported an error]
+ */
+int io61_async_flush(io61_file* f)
+{
+    asyncring* ring = f -> async;
+    if(f -> mode == O_RDONLY)
+        return SUCCESS;
+
+    pthread_mutex_lock(&ring -> mutex);
+    if(ring -> bufs[ring -> prod].len > 0)
+    {
+        while(ring -> count == ring -> nbufs)
+            pthread_cond_wait(&ring -> consumed, &ring -> mutex);
+        ring -> prod = (ring -> prod + 1) % ring -> nbufs;
+        ring -> count++;
+        pthread_cond_signal(&ring -> produced);
+    }
+    while(ring -> count > 0)
+        pthread_cond_wait(&ring -> consumed, &ring -> mutex);
+    int r = ring -> error ? FAIL : SUCCESS;
+    pthread_mutex_unlock(&ring -> mutex);
+
+    return r;
+}
+
+/**
+ * [io61_uring_start switches `f` to the io_uring backend. Only regular files are supported,
+ *                   since every request carries an explicit file offset.]
+ * @param  f [file]
+ * @return   [0 on success, -1 if io_uring is unavailable (the file keeps using read/write)]
+ */
+int io61_uring_start(io61_file* f)
+{
+#ifdef HAVE_URING
+    if(f -> uring)
+        return SUCCESS;
+    if(io61_filesize(f) < 0 || f -> async || f -> zip || f -> crc)
+        return FAIL;
+
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    int ringfd = syscall(__NR_io_uring_setup, URINGDEPTH, &p);
+    if(ringfd < 0)
+        return FAIL;
+
+    uringring* ring = (uringring*) malloc(sizeof(uringring));
+    if(ring == NULL)
+    {
+        close(ringfd);
+        errno = ENOMEM;
+        return FAIL;
+    }
+    memset(ring, 0, sizeof(uringring));
+    ring -> ringfd = ringfd;
+    ring -> fd = f -> fd;
+    ring -> file = f;
+    ring -> writer = (f -> mode != O_RDONLY);
+
+    ring -> sqmapsz = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    ring -> cqmapsz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    ring -> sqesz = p.sq_entries * sizeof(struct io_uring_sqe);
+    ring -> sqmap = mmap(NULL, ring -> sqmapsz, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, ringfd, IORING_OFF_SQ_RING);
+    ring -> cqmap = mmap(NULL, ring -> cqmapsz, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, ringfd, IORING_OFF_CQ_RING);
+    ring -> sqes = mmap(NULL, ring -> sqesz, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ringfd, IORING_OFF_SQES);
+    ring -> mem = mmap(NULL, URINGDEPTH * BUFSIZE, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(ring -> mem != MAP_FAILED)
+    {
+        io61_memadd(URINGDEPTH * BUFSIZE);
+        io61_fileadd(f, URINGDEPTH * BUFSIZE);
+    }
+    if(ring -> sqmap == MAP_FAILED || ring -> cqmap == MAP_FAILED
+       || ring -> sqes == MAP_FAILED || ring -> mem == MAP_FAILED)
+    {
+        f -> uring = ring;
+        io61_uring_stop(f);
+        return FAIL;
+    }
+
+    char* sq = (char*) ring -> sqmap;
+    char* cq = (char*) ring -> cqmap;
+    ring -> sqhead = (unsigned*) (sq + p.sq_off.head);
+    ring -> sqtail = (unsigned*) (sq + p.sq_off.tail);
+    ring -> sqmask = (unsigned*) (sq + p.sq_off.ring_mask);
+    ring -> sqarray = (unsigned*) (sq + p.sq_off.array);
+    ring -> cqhead = (unsigned*) (cq + p.cq_off.head);
+    ring -> cqtail = (unsigned*) (cq + p.cq_off.tail);
+    ring -> cqmask = (unsigned*) (cq + p.cq_off.ring_mask);
+    ring -> cqes = (struct io_uring_cqe*) (cq + p.cq_off.cqes);
+
+    // registered buffers spare the kernel from pinning pages on every request;
+    // if RLIMIT_MEMLOCK is too small we fall back to ordinary reads and writes
+    struct iovec iov[URINGDEPTH];
+    for(int i = 0; i < URINGDEPTH; i++)
+    {
+        iov[i].iov_base = ring -> mem + i * BUFSIZE;
+        iov[i].iov_len = BUFSIZE;
+        ring -> bufs[i].state = UB_FREE;
+    }
+    ring -> fixed = syscall(__NR_io_uring_register, ringfd, IORING_REGISTER_BUFFERS,
+                            iov, URINGDEPTH) == 0;
+    ring -> cur = -1;
+    ring -> lastblock = -1;
+
+    f -> uring = ring;
+    f -> pos = lseek(f -> fd, 0, SEEK_CUR);
+    return SUCCESS;
+#else
+    (void) f;
+    return FAIL;
+#endif
+}
+
+#ifdef HAVE_URING
+/**
+ * [io61_uring_stop waits for outstanding requests of `f` and tears down its ring.
+ *                  Buffered write data must have been flushed.]
+ * @param  f [file]
+ * @return   [0 on success, -1 if an earlier request failed]
+ */
+int io61_uring_stop(io61_file* f)
+{
+    uringring* ring = f -> uring;
+    if(ring == NULL)
+        return SUCCESS;
+
+    if(ring -> sqtail)
+        io61_uring_submit(ring, ring -> inflight);
+
+    int r = ring -> error ? FAIL : SUCCESS;
+    if(ring -> sqmap != MAP_FAILED)
+        munmap(ring -> sqmap, ring -> sqmapsz);
+    if(ring -> cqmap != MAP_FAILED)
+        munmap(ring -> cqmap, ring -> cqmapsz);
+    if(ring -> sqes != MAP_FAILED)
+        munmap(ring -> sqes, ring -> sqesz);
+    if(ring -> mem != MAP_FAILED)
+    {
+        munmap(ring -> mem, URINGDEPTH * BUFSIZE);
+        io61_memadd(-(ssize_t) URINGDEPTH * BUFSIZE);
+        io61_fileadd(f, -(ssize_t) URINGDEPTH * BUFSIZE);
+    }
+    close(ring -> ringfd);
+    free(ring);
+    f -> uring = NULL;
+
+    // keep the descriptor's offset meaningful for whoever uses it next
+    long long start = io61_clock();
+    io61_count(f, SYS_LSEEK, start, lseek(f -> fd, f -> pos, SEEK_SET) == (off_t) -1 ? FAIL : 0);
+    return r;
+}
+
+/**
+ * [io61_uring_queue prepares a read or write of buffer `i` at its file position.
+ *                   Nothing reaches the kernel until io61_uring_submit.]
+ * @param ring [ring]
+ * @param i    [buffer index]
+ * @param op   [IORING_OP_READ_FIXED or IORING_OP_WRITE_FIXED]
+ * @param done [bytes of the buffer already transferred (non-zero for short transfers)]
+ */
+void io61_uring_queue(uringring* ring, int i, int op, size_t done)
+{
+    uringbuf* b = &ring -> bufs[i];
+    unsigned tail = *ring -> sqtail;
+    unsigned idx = tail & *ring -> sqmask;
+    struct io_uring_sqe* sqe = &ring -> sqes[idx];
+
+    memset(sqe, 0, sizeof(*sqe));
+    if(!ring -> fixed)
+        op = (op == IORING_OP_READ_FIXED ? IORING_OP_READ : IORING_OP_WRITE);
+    sqe -> opcode = op;
+    sqe -> fd = ring -> fd;
+    sqe -> off = b -> pos + done;
+    sqe -> addr = (unsigned long) (ring -> mem + i * BUFSIZE + done);
+    sqe -> len = (op == IORING_OP_READ_FIXED || op == IORING_OP_READ ? BUFSIZE : b -> len) - done;
+    sqe -> buf_index = ring -> fixed ? i : 0;
+    sqe -> user_data = i;
+
+    ring -> sqarray[idx] = idx;
+    __atomic_store_n(ring -> sqtail, tail + 1, __ATOMIC_RELEASE);
+    ring -> tosubmit++;
+    ring -> inflight++;
+    b -> state = UB_INFLIGHT;
+    b -> done = done;
+}
+
+/**
+ * [io61_uring_submit hands every queued request to the kernel with one io_uring_enter
+ *                    and reaps completions until at least `wait` requests have finished]
+ * @param ring [ring]
+ * @param wait [number of completions to wait for]
+ */
+void io61_uring_submit(uringring* ring, unsigned wait)
+{
+    while(ring -> tosubmit > 0 || wait > 0)
+    {
+        unsigned flags = wait > 0 ? IORING_ENTER_GETEVENTS : 0;
+        if(wait > ring -> inflight)
+            wait = ring -> inflight;
+        long long start = io61_clock();
+        int r = syscall(__NR_io_uring_enter, ring -> ringfd, ring -> tosubmit, wait, flags, NULL, 0);
+        io61_count(ring -> file, SYS_URING, start, r < 0 ? FAIL : 0);
+        if(r < 0 && errno != EINTR)
+        {
+            ring -> error = errno;
+            return;
+        }
+        if(r > 0)
+            ring -> tosubmit -= r;
+
+        unsigned reaped = io61_uring_reap(ring);
+        wait = reaped >= wait ? 0 : wait - reaped;
+    }
+}
+
+/**
+ * [io61_uring_reap processes all available completions. Reads become UB_READY blocks;
+ *                  short reads and writes are requeued for the remainder.]
+ * @param  ring [ring]
+ * @return      [number of requests that finished]
+ */
+unsigned io61_uring_reap(uringring* ring)
+{
+    unsigned head = *ring -> cqhead;
+    unsigned tail = __atomic_load_n(ring -> cqtail, __ATOMIC_ACQUIRE);
+    unsigned finished = 0;
+
+    for(; head != tail; head++)
+    {
+        struct io_uring_cqe* cqe = &ring -> cqes[head & *ring -> cqmask];
+        int i = (int) cqe -> user_data;
+        uringbuf* b = &ring -> bufs[i];
+        int res = cqe -> res;
+        ring -> inflight--;
+
+        if(res < 0)
+        {
+            ring -> error = -res;
+            res = 0;
+        }
+        if(ring -> writer)
+            ring -> file -> stats.bytesout += res;
+        else
+            ring -> file -> stats.bytesin += res;
+
+        // short transfers are continued; a read only stops short at end-of-file
+        size_t total = b -> done + res;
+        if(res > 0 && total < (ring -> writer ? b -> len : BUFSIZE))
+        {
+            io61_uring_queue(ring, i, ring -> writer ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED, total);
+            continue;
+        }
+
+        if(ring -> writer)
+            b -> state = UB_FREE;
+        else
+        {
+            b -> len = total;
+            b -> state = UB_READY;
+        }
+        finished++;
+    }
+
+    __atomic_store_n(ring -> cqhead, head, __ATOMIC_RELEASE);
+    return finished;
+}
+
+/**
+ * [io61_uring_find looks up the buffer holding the block at `pos`]
+ * @param  ring [ring]
+ * @param  pos  [block-aligned file position]
+ * @return      [buffer index, or -1 if the block is neither cached nor in flight]
+ */
+int io61_uring_find(uringring* ring, off_t pos)
+{
+    for(int i = 0; i < URINGDEPTH; i++)
+        if(ring -> bufs[i].state != UB_FREE && ring -> bufs[i].pos == pos)
+            return i;
+
+    return -1;
+}
+
+/**
+ * [io61_uring_prefetch queues reads for up to `n` blocks from `pos` on, in direction `dir`,
+ *                      that are not cached yet. All of them reach the kernel with the next
+ *                      io_uring_enter. The least recently used blocks are recycled, but
+ *                      never one of the window itself.]
+ * @param ring [ring]
+ * @param pos  [block-aligned file position]
+ * @param n    [number of blocks]
+ * @param dir  [1 to read ahead, -1 to read backwards]
+ */
+void io61_uring_prefetch(uringring* ring, off_t pos, int n, int dir)
+{
+    off_t lo = dir > 0 ? pos : pos - (off_t) (n - 1) * BUFSIZE;
+    off_t hi = dir > 0 ? pos + (off_t) (n - 1) * BUFSIZE : pos;
+
+    for(int k = 0; k < n && pos >= 0; k++, pos += dir * BUFSIZE)
+    {
+        if(io61_uring_find(ring, pos) >= 0)
+            continue;
+
+        int victim = -1;
+        for(int i = 0; i < URINGDEPTH; i++)
+        {
+            uringbuf* b = &ring -> bufs[i];
+            if(b -> state == UB_FREE)
+            {
+                victim = i;
+                break;
+            }
+            if(b -> state == UB_READY && i != ring -> cur && (b -> pos < lo || b -> pos > hi)
+               && (victim < 0 || b -> used < ring -> bufs[victim].used))
+                victim = i;
+        }
+        if(victim < 0)
+            return;
+
+        ring -> bufs[victim].pos = pos;
+        ring -> bufs[victim].used = ++ring -> clock;
+        io61_uring_queue(ring, victim, IORING_OP_READ_FIXED, 0);
+    }
+}
+
+/**
+ * [io61_uring_read io61_read for files on the io_uring backend. Sequential access, forwards
+ *                  or backwards, keeps most of the ring in flight as read-ahead, topped up
+ *                  half a window at a time so that each io_uring_enter carries a batch of
+ *                  requests; random access costs one io_uring_enter per missed block instead
+ *                  of an lseek plus a read.]
+ * @param  f   [file]
+ * @param  buf [destination]
+ * @param  sz  [number of bytes requested]
+ * @return     [number of bytes read; -1 if an error occurred before any bytes were read]
+ */
+ssize_t io61_uring_read(io61_file* f, char* buf, size_t sz)
+{
+    uringring* ring = f -> uring;
+    size_t nread = 0;
+
+    while(nread < sz)
+    {
+        off_t block = f -> pos - f -> pos % BUFSIZE;
+        int i = ring -> cur;
+
+        if(i < 0 || ring -> bufs[i].state != UB_READY || ring -> bufs[i].pos != block)
+        {
+            // the block being read and the one before it stay out of the window
+            int dir = block == ring -> lastblock + BUFSIZE ? 1
+                      : (block == ring -> lastblock - BUFSIZE ? -1 : 0);
+            int window = dir ? URINGDEPTH - 2 : 1;
+            ring -> lastblock = block;
+
+            // protect the block from being recycled by its own read-ahead, and only
+            // top up the window once half of it has been consumed
+            i = io61_uring_find(ring, block);
+            if(i >= 0)
+                ring -> cur = i;
+            off_t half = block + dir * (window / 2) * BUFSIZE;
+            if(i < 0 || (window > 1 && half >= 0 && io61_uring_find(ring, half) < 0))
+                io61_uring_prefetch(ring, block, window, dir ? dir : 1);
+            i = io61_uring_find(ring, block);
+            if(i < 0)
+            {
+                // every buffer is in flight: wait for some to finish, then retry
+                io61_uring_submit(ring, 1);
+                continue;
+            }
+            while(ring -> bufs[i].state == UB_INFLIGHT && !ring -> error)
+                io61_uring_submit(ring, 1);
+            if(ring -> bufs[i].state == UB_INFLIGHT)
+                return nread ? (ssize_t) nread : FAIL;
+            io61_uring_submit(ring, 0);     // start any read-ahead still queued
+            ring -> cur = i;
+        }
+
+        uringbuf* b = &ring -> bufs[i];
+        b -> used = ++ring -> clock;
+        size_t off = f -> pos - block;
+        if(off >= b -> len)
+        {
+            if(ring -> error && nread == 0)
+                return FAIL;
+            break;          // end of file
+        }
+
+        size_t n = b -> len - off;
+        if(n > sz - nread)
+            n = sz - nread;
+        memcpy(buf + nread, ring -> mem + i * BUFSIZE + off, n);
+        nread += n;
+        f -> pos += n;
+    }
+
+    return nread;
+}
+
+/**
+ * [io61_uring_write io61_write for files on the io_uring backend. Data is gathered into
+ *                   registered buffers tagged with their file offsets; full buffers are
+ *                   queued and submitted in one batch once the ring runs out of buffers.]
+ * @param  f   [file]
+ * @param  buf [source]
+ * @param  sz  [number of bytes to write]
+ * @return     [number of bytes written, normally `sz`;
+ *              -1 if an error occurred before any bytes were written]
+ */
+ssize_t io61_uring_write(io61_file* f, const char* buf, size_t sz)
+{
+    uringring* ring = f -> uring;
+    size_t nwritten = 0;
+
+    while(nwritten < sz)
+    {
+        if(ring -> error)
+            return nwritten ? (ssize_t) nwritten : FAIL;
+
+        int i = ring -> cur;
+        if(i >= 0 && (ring -> bufs[i].len == BUFSIZE
+                      || ring -> bufs[i].pos + (off_t) ring -> bufs[i].len != f -> pos))
+        {
+            io61_uring_retire(ring);
+            i = -1;
+        }
+
+        if(i < 0)
+        {
+            for(i = 0; i < URINGDEPTH && ring -> bufs[i].state != UB_FREE; i++)
+                ;
+            if(i == URINGDEPTH)
+            {
+                io61_uring_submit(ring, 1);
+                continue;
+            }
+            ring -> bufs[i].state = UB_FILLING;
+            ring -> bufs[i].pos = f -> pos;
+            ring -> bufs[i].len = 0;
+            ring -> cur = i;
+        }
+
+        uringbuf* b = &ring -> bufs[i];
+        size_t n = BUFSIZE - b -> len;
+        if(n > sz - nwritten)
+            n = sz - nwritten;
+        memcpy(ring -> mem + i * BUFSIZE + b -> len, buf + nwritten, n);
+        b -> len += n;
+        nwritten += n;
+        f -> pos += n;
+    }
+
+    return nwritten;
+}
+
+/**
+ * [io61_uring_retire queues the buffer being filled by the writer. Requests to
+ *                    overlapping ranges may complete in any order, so an overlap
+ *                    first drains everything in flight.]
+ * @param ring [ring]
+ */
+void io61_uring_retire(uringring* ring)
+{
+    int i = ring -> cur;
+    if(i < 0)
+        return;
+    ring -> cur = -1;
+
+    uringbuf* b = &ring -> bufs[i];
+    if(b -> len == 0)
+    {
+        b -> state = UB_FREE;
+        return;
+    }
+
+    for(int j = 0; j < URINGDEPTH; j++)
+    {
+        uringbuf* o = &ring -> bufs[j];
+        if(o -> state == UB_INFLIGHT && o -> pos < b -> pos + (off_t) b -> len
+           && b -> pos < o -> pos + (off_t) o -> len)
+        {
+            io61_uring_submit(ring, ring -> inflight);
+            break;
+        }
+    }
+
+    io61_uring_queue(ring, i, IORING_OP_WRITE_FIXED, 0);
+}
+
+/**
+ * [io61_uring_flush submits all buffered writes of `f` and waits for them]
+ * @param  f [file]
+ * @return   [0 on success, -1 if a request failed]
+ */
+int io61_uring_flush(io61_file* f)
+{
+    uringring* ring = f -> uring;
+    if(!ring -> writer)
+        return SUCCESS;
+
+    io61_uring_retire(ring);
+    io61_uring_submit(ring, ring -> inflight);
+
+    return ring -> error ? FAIL : SUCCESS;
+}
+#endif
+
+/**
+ * [io61_zip_start switches `f` to a compressed stream. A writer writes the stream header and
+ *                 from then on its output is cut into frames of ZIPBLOCK bytes, which a helper
+ *                 thread compresses and writes while the application goes on. A reader checks
+ *                 for the stream header and, on a regular file, loads the frame index from the
+ *                 trailer; its helper thread reads and decompresses frames ahead of the
+ *                 application until a seek leaves them behind (see io61_zip_seek).
+ *                 Must be called before any data is read from or written to `f`.]
+ * @param  f [file opened O_RDONLY or O_WRONLY]
+ * @return   [0 on success; -1 if `f` cannot be compressed or a reader's data is not a
+ *            compressed stream (a pipe's bytes read to find out are still read next,
+ *            unless errno is ENOMEM)]
+ */
+int io61_zip_start(io61_file* f)
+{
+    if(f -> zip)
+        return SUCCESS;
+    if(f -> mode == O_RDWR || f -> async || f -> uring || f -> direct || f -> crc || f -> slot >= 0)
+    {
+        errno = EINVAL;
+        return FAIL;
+    }
+
+    zipring* ring = (zipring*) malloc(sizeof(zipring));
+    if(ring == NULL)
+    {
+        errno = ENOMEM;
+        return FAIL;
+    }
+    ring -> seekable = io61_filesize(f) >= 0;
+    ring -> base = ring -> seekable ? lseek(f -> fd, 0, SEEK_CUR) : 0;
+    if(ring -> base == (off_t) -1)
+    {
+        ring -> seekable = FALSE;
+        ring -> base = 0;
+    }
+    ring -> zpos = ZIPHEADER;
+    ring -> rawpos = 0;
+    ring -> frames = NULL;
+    ring -> nframes = ring -> framecap = 0;
+    ring -> rawsize = -1;
+
+    // the ring shrinks to fit the memory budget; a writer also keeps the compressor's table.
+    // It is allocated before the header is read or written, so that a file without room for
+    // it is left as it was
+    int nbufs = ZIPBUFS;
+    size_t extra = ZIPFRAME + ZIPBLOCK + (f -> mode == O_RDONLY ? 0 : sizeof(uint16_t) << ZIPHASHLOG);
+    while(nbufs > 2 && io61_overbudget(f, nbufs * ZIPBLOCK + extra))
+        nbufs--;
+    ring -> bufs = (zipbuf*) malloc(nbufs * sizeof(zipbuf));
+    ring -> nbufs = 0;
+    while(ring -> bufs && ring -> nbufs < nbufs
+          && (ring -> bufs[ring -> nbufs].data = (char*) malloc(ZIPBLOCK)) != NULL)
+    {
+        ring -> bufs[ring -> nbufs].len = 0;
+        ring -> bufs[ring -> nbufs].offset = 0;
+        ring -> bufs[ring -> nbufs].rawpos = 0;
+        ring -> nbufs++;
+    }
+    ring -> zdata = (char*) malloc(ZIPFRAME + ZIPBLOCK);
+    ring -> raw = NULL;
+    ring -> table = f -> mode == O_RDONLY ? NULL : (uint16_t*) calloc(1 << ZIPHASHLOG, sizeof(uint16_t));
+    ring -> mem = nbufs * ZIPBLOCK + extra;
+    ring -> prod = ring -> cons = ring -> count = 0;
+    ring -> held = FALSE;
+    ring -> stop = FALSE;
+    ring -> error = 0;
+    pthread_mutex_init(&ring -> mutex, NULL);
+    pthread_cond_init(&ring -> produced, NULL);
+    pthread_cond_init(&ring -> consumed, NULL);
+
+    // from here on, a failure frees the ring as one whose helper never started
+    int err = 0;
+    if(ring -> nbufs < nbufs || ring -> zdata == NULL || (f -> mode != O_RDONLY && ring -> table == NULL))
+        err = ENOMEM;
+
+    unsigned char hdr[ZIPHEADER];
+    if(err == 0 && f -> mode == O_RDONLY)
+    {
+        // a pipe is read only as far as the bytes keep matching the header
+        ssize_t n = 0;
+        while(n < ZIPHEADER && memcmp(hdr, ZIPMAGIC, n < 4 ? n : 4) == 0)
+        {
+            ssize_t r = io61_zip_readall(f, ring, (char*) hdr + n, ring -> seekable ? ZIPHEADER : 1, n);
+            if(r <= 0)
+                break;
+            n += r;
+        }
+        if(n < ZIPHEADER || memcmp(hdr, ZIPMAGIC, 4) != 0 || io61_get32(hdr + 4) != ZIPVERSION)
+        {
+            // without a stream buffer for them, a pipe's bytes are lost and it is an error
+            err = EINVAL;
+            if(!ring -> seekable && n > 0)
+            {
+                int i = io61_getslot(f);
+                if(i >= 0)
+                {
+                    memcpy(cache[i].data, hdr, n);
+                    cache[i].bufsize = n;
+                }else
+                    err = ENOMEM;
+            }
+        }else if(ring -> seekable)
+            io61_zip_index(f, ring);
+    }else if(err == 0)
+    {
+        memcpy(hdr, ZIPMAGIC, 4);
+        io61_put32(hdr + 4, ZIPVERSION);
+        struct iovec iov = {hdr, ZIPHEADER};
+        if(io61_writev_all(f, &iov, 1) != ZIPHEADER)
+            err = errno ? errno : EIO;
+    }
+
+    if(err)
+    {
+        ring -> nbufs = -ring -> nbufs;
+        ring -> mem = 0;        // nothing is charged yet
+        f -> zip = ring;
+        io61_zip_free(f);
+        errno = err;
+        return FAIL;
+    }
+
+    f -> zip = ring;
+    if(pthread_create(&ring -> thread, NULL,
+                      f -> mode == O_RDONLY ? io61_zip_reader : io61_zip_writer, f) != 0)
+    {
+        ring -> nbufs = -ring -> nbufs;
+        io61_zip_free(f);
+        return FAIL;
+    }
+    // the ring is malloc'd, not taken from the pool, so it is charged to the budget here
+    io61_memadd(ring -> mem);
+    io61_fileadd(f, ring -> mem);
+
+    return SUCCESS;
+}
+
+/**
+ * [io61_zip_stop terminates the helper thread of `f` and frees the ring buffers; the index
+ *                stays for the block cache. A writer's pending output must have been flushed;
+ *                its stream is then closed with the end frame, the frame index and the
+ *                trailer.]
+ * @param  f [file]
+ * @return   [0 on success, -1 if a write failed]
+ */
+int io61_zip_stop(io61_file* f)
+{
+    zipring* ring = f -> zip;
+    if(ring == NULL || ring -> nbufs <= 0)
+        return SUCCESS;
+
+    pthread_mutex_lock(&ring -> mutex);
+    ring -> stop = TRUE;
+    pthread_cond_broadcast(&ring -> produced);
+    pthread_cond_broadcast(&ring -> consumed);
+    pthread_mutex_unlock(&ring -> mutex);
+
+    if(f -> mode == O_RDONLY)
+        pthread_cancel(ring -> thread);
+    pthread_join(ring -> thread, NULL);
+
+    int r = SUCCESS;
+    if(ring -> error)
+    {
+        errno = ring -> error;
+        r = FAIL;
+    }
+    if(f -> mode != O_RDONLY && r == SUCCESS)
+    {
+        // end frame, then (raw offset, stream offset) of every frame, then the trailer
+        size_t n = ZIPFRAME + ring -> nframes * 16 + ZIPTRAILER;
+        unsigned char* t = (unsigned char*) calloc(n, 1);
+        if(t == NULL)
+        {
+            errno = ENOMEM;
+            r = FAIL;
+        }
+        for(size_t k = 0; t && k < ring -> nframes; k++)
+        {
+            io61_put64(t + ZIPFRAME + 16 * k, ring -> frames[k].rawpos);
+            io61_put64(t + ZIPFRAME + 16 * k + 8, ring -> frames[k].zpos);
+        }
+        if(t)
+        {
+            unsigned char* trailer = t + n - ZIPTRAILER;
+            io61_put64(trailer, ring -> rawpos);
+            io61_put64(trailer + 8, ring -> nframes);
+            memcpy(trailer + 16, ZIPMAGIC, 4);
+            io61_put32(trailer + 20, ZIPVERSION);
+
+            struct iovec iov = {t, n};
+            if(io61_writev_all(f, &iov, 1) != (ssize_t) n)
+                r = FAIL;
+            free(t);
+        }
+    }
+
+    for(int i = 0; i < ring -> nbufs; i++)
+        free(ring -> bufs[i].data);
+    io61_memadd(-(ssize_t) ring -> nbufs * ZIPBLOCK);
+    io61_fileadd(f, -(ssize_t) ring -> nbufs * ZIPBLOCK);
+    ring -> mem -= ring -> nbufs * ZIPBLOCK;
+    ring -> nbufs = 0;
+
+    return r;
+}
+
+/**
+ * [io61_zip_free frees what is left of the compressed stream of `f` once its helper thread has
+ *                exited, or never started (`nbufs` < 0)]
+ * @param f [file]
+ */
+void io61_zip_free(io61_file* f)
+{
+    zipring* ring = f -> zip;
+    for(int i = 0; i < -ring -> nbufs; i++)
+        free(ring -> bufs[i].data);
+    if(ring -> nbufs == 0)
+    {
+        io61_memadd(-(ssize_t) ring -> mem);
+        io61_fileadd(f, -(ssize_t) ring -> mem);
+    }
+    free(ring -> bufs);
+    free(ring -> zdata);
+    free(ring -> raw);
+    free(ring -> table);
+    free(ring -> frames);
+    pthread_mutex_destroy(&ring -> mutex);
+    pthread_cond_destroy(&ring -> produced);
+    pthread_cond_destroy(&ring -> consumed);
+    free(ring);
+    f -> zip = NULL;
+}
+
+/**
+ * [io61_zip_index loads the frame index of the compressed regular file `f` from its trailer.
+ *                 A stream without one (still being written, or cut short) is read in order
+ *                 only.]
+ * @param  f    [file]
+ * @param  ring [ring being set up]
+ * @return      [0 if the index was loaded, -1 otherwise]
+ */
+int io61_zip_index(io61_file* f, zipring* ring)
+{
+    ssize_t size = io61_filesize(f) - ring -> base;
+    unsigned char trailer[ZIPTRAILER];
+    if(size < ZIPHEADER + ZIPFRAME + ZIPTRAILER
+       || io61_zip_readall(f, ring, (char*) trailer, ZIPTRAILER, size - ZIPTRAILER) != ZIPTRAILER
+       || memcmp(trailer + 16, ZIPMAGIC, 4) != 0 || io61_get32(trailer + 20) != ZIPVERSION)
+        return FAIL;
+
+    // the end frame comes right before the index
+    unsigned long long nframes = io61_get64(trailer + 8);
+    if(nframes > (unsigned long long) (size - ZIPHEADER - ZIPFRAME - ZIPTRAILER) / 16)
+        return FAIL;
+    size_t n = nframes * 16;
+    off_t end = size - ZIPTRAILER - n - ZIPFRAME;
+    unsigned char* t = (unsigned char*) malloc(n + 1);
+    zipframe* frames = (zipframe*) malloc((nframes + 1) * sizeof(zipframe));
+    if(t == NULL || frames == NULL
+       || io61_zip_readall(f, ring, (char*) t, n, end + ZIPFRAME) != (ssize_t) n)
+    {
+        free(t);
+        free(frames);
+        return FAIL;
+    }
+    for(size_t k = 0; k < nframes; k++)
+    {
+        frames[k].rawpos = io61_get64(t + 16 * k);
+        frames[k].zpos = io61_get64(t + 16 * k + 8);
+    }
+    free(t);
+
+    // a sentinel frame maps the end of the data to the end frame
+    frames[nframes].rawpos = io61_get64(trailer);
+    frames[nframes].zpos = end;
+    ring -> frames = frames;
+    ring -> nframes = nframes;
+    ring -> rawsize = frames[nframes].rawpos;
+    return SUCCESS;
+}
+
+/**
+ * [io61_zip_readall reads `n` bytes of the compressed stream of `f`, at offset `zpos` of the
+ *                   stream if it is a regular file, or next from a pipe]
+ * @param  f    [file]
+ * @param  ring [ring]
+ * @param  buf  [destination]
+ * @param  n    [number of bytes]
+ * @param  zpos [offset from the stream header]
+ * @return      [number of bytes read, short only at end of file; -1 on error]
+ */
+ssize_t io61_zip_readall(io61_file* f, zipring* ring, char* buf, size_t n, off_t zpos)
+{
+    size_t nread = 0;
+
+    while(nread < n)
+    {
+        ssize_t r;
+        long long start = io61_clock();
+        if(ring -> seekable)
+        {
+            r = pread(f -> fd, buf + nread, n - nread, ring -> base + zpos + nread);
+            io61_count(f, SYS_PREAD, start, r);
+        }else
+        {
+            r = read(f -> fd, buf + nread, n - nread);
+            io61_count(f, SYS_READ, start, r);
+        }
+        if(r == -1 && errno == EINTR)
+            continue;
+        if(r == -1)
+            return FAIL;
+        if(r == 0)
+            break;
+        nread += r;
+    }
+
+    return nread;
+}
+
+/**
+ * [io61_zip_unpack decodes the frame at `frame` (header and stored bytes) into `dst`]
+ * @param  frame [frame]
+ * @param  n     [bytes at `frame`]
+ * @param  dst   [ZIPBLOCK bytes]
+ * @return       [number of raw bytes, 0 for the end frame, or -1 if the frame is damaged]
+ */
+ssize_t io61_zip_unpack(const char* frame, size_t n, char* dst)
+{
+    size_t raw = io61_get32((const unsigned char*) frame);
+    size_t stored = io61_get32((const unsigned char*) frame + 4);
+    if(raw > ZIPBLOCK || stored > raw || n != ZIPFRAME + stored)
+        return FAIL;
+    if(stored == raw)
+    {
+        memcpy(dst, frame + ZIPFRAME, raw);
+        return raw;
+    }
+    return io61_lz_decompress(frame + ZIPFRAME, stored, dst, raw) == (ssize_t) raw ? (ssize_t) raw : FAIL;
+}
+
+/**
+ * [io61_zip_reader helper thread body for compressed readers. Reads frames in order and
+ *                  decompresses them into free buffers until the end of the data or an error,
+ *                  which is passed to the application as a buffer with `len` 0 or -1.
+ *                  Cancellation is only enabled around the reads, which may block forever on
+ *                  a pipe that is never written again.]
+ * @param  arg [io61_file*]
+ * @return     [NULL]
+ */
+void* io61_zip_reader(void* arg)
+{
+    io61_file* f = (io61_file*) arg;
+    zipring* ring = f -> zip;
+    off_t zpos = ring -> zpos;
+    off_t rawpos = 0;
+    pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+
+    while(1)
+    {
+        pthread_mutex_lock(&ring -> mutex);
+        while(ring -> count == ring -> nbufs && !ring -> stop)
+            pthread_cond_wait(&ring -> consumed, &ring -> mutex);
+        if(ring -> stop)
+        {
+            pthread_mutex_unlock(&ring -> mutex);
+            return NULL;
+        }
+        pthread_mutex_unlock(&ring -> mutex);
+
+        // the producer owns bufs[prod] as long as the ring is not full; a stream that ends
+        // between frames ends the data like the end frame
+        zipbuf* b = &ring -> bufs[ring -> prod];
+        size_t stored = 0;
+        ssize_t len = FAIL;
+        pthread_setcancelstate(PTHREAD_CANCEL_ENABLE, NULL);
+        ssize_t n = io61_zip_readall(f, ring, ring -> zdata, ZIPFRAME, zpos);
+        if(n == 0)
+            len = 0;
+        else if(n == ZIPFRAME)
+        {
+            stored = io61_get32((unsigned char*) ring -> zdata + 4);
+            if(io61_get32((unsigned char*) ring -> zdata) == 0)
+                len = 0;
+            else if(stored <= ZIPBLOCK
+                    && io61_zip_readall(f, ring, ring -> zdata + ZIPFRAME, stored, zpos + ZIPFRAME)
+                       == (ssize_t) stored)
+                len = io61_zip_unpack(ring -> zdata, ZIPFRAME + stored, b -> data);
+        }
+        pthread_setcancelstate(PTHREAD_CANCEL_DISABLE, NULL);
+        b -> len = len;
+        b -> offset = 0;
+        b -> rawpos = rawpos;
+        zpos += ZIPFRAME + stored;
+        rawpos += len > 0 ? len : 0;
+
+        pthread_mutex_lock(&ring -> mutex);
+        ring -> prod = (ring -> prod + 1) % ring -> nbufs;
+        ring -> count++;
+        ring -> rawpos = rawpos;
+        pthread_cond_signal(&ring -> produced);
+        pthread_mutex_unlock(&ring -> mutex);
+
+        if(len <= 0)
+            return NULL;
+    }
+}
+
+/**
+ * [io61_zip_writer helper thread body for compressed writers. Compresses full buffers in
+ *                  order, writes each as one frame (stored as is when compression does not
+ *                  pay), records it in the index and hands the buffer back.]
+ * @param  arg [io61_file*]
+ * @return     [NULL]
+ */
+void* io61_zip_writer(void* arg)
+{
+    io61_file* f = (io61_file*) arg;
+    zipring* ring = f -> zip;
+    off_t zpos = ring -> zpos;
+    off_t rawpos = 0;
+
+    while(1)
+    {
+        pthread_mutex_lock(&ring -> mutex);
+        while(ring -> count == 0 && !ring -> stop)
+            pthread_cond_wait(&ring -> produced, &ring -> mutex);
+        if(ring -> count == 0)
+        {
+            pthread_mutex_unlock(&ring -> mutex);
+            return NULL;
+        }
+        pthread_mutex_unlock(&ring -> mutex);
+
+        zipbuf* b = &ring -> bufs[ring -> cons];
+        size_t raw = b -> len;
+        size_t stored = io61_lz_compress(b -> data, raw, ring -> zdata, raw - 1, ring -> table);
+        unsigned char hdr[ZIPFRAME];
+        io61_put32(hdr, raw);
+        io61_put32(hdr + 4, stored ? stored : raw);
+        struct iovec iov[2] = {{hdr, ZIPFRAME}, {stored ? ring -> zdata : b -> data, stored ? stored : raw}};
+        size_t total = ZIPFRAME + iov[1].iov_len;
+        int error = 0;
+        if(io61_writev_all(f, iov, 2) != (ssize_t) total)
+            error = errno ? errno : EIO;
+
+        if(ring -> nframes == ring -> framecap)
+        {
+            // an index that cannot grow fails the stream, which then gets no trailer
+            size_t cap = ring -> framecap ? 2 * ring -> framecap : 64;
+            zipframe* frames = (zipframe*) realloc(ring -> frames, cap * sizeof(zipframe));
+            if(frames)
+            {
+                ring -> frames = frames;
+                ring -> framecap = cap;
+            }else if(!error)
+                error = ENOMEM;
+        }
+        if(ring -> nframes < ring -> framecap)
+        {
+            ring -> frames[ring -> nframes].rawpos = rawpos;
+            ring -> frames[ring -> nframes].zpos = zpos;
+            ring -> nframes++;
+        }
+        zpos += total;
+        rawpos += raw;
+        b -> len = 0;
+        b -> offset = 0;
+
+        pthread_mutex_lock(&ring -> mutex);
+        if(error && !ring -> error)
+            ring -> error = error;
+        ring -> cons = (ring -> cons + 1) % ring -> nbufs;
+        ring -> count--;
+        pthread_cond_signal(&ring -> consumed);
+        pthread_mutex_unlock(&ring -> mutex);
+    }
+}
+
+/**
+ * [io61_zip_rdbuf returns the buffer a compressed reader is reading from, waiting for the
+ *                 helper thread if none is ready yet]
+ * @param  ring [ring of a compressed reader]
+ * @return      [buffer with unread data, or the end-of-data/error buffer]
+ */
+zipbuf* io61_zip_rdbuf(zipring* ring)
+{
+    zipbuf* b = &ring -> bufs[ring -> cons];
+
+    // fast path: the current buffer still has data and belongs to us
+    if(ring -> held && b -> len > 0 && b -> offset < (size_t) b -> len)
+        return b;
+
+    pthread_mutex_lock(&ring -> mutex);
+    if(ring -> held && b -> len > 0)
+    {
+        // finished with this buffer, give it back to the helper thread
+        ring -> cons = (ring -> cons + 1) % ring -> nbufs;
+        ring -> count--;
+        ring -> held = FALSE;
+        pthread_cond_signal(&ring -> consumed);
+        b = &ring -> bufs[ring -> cons];
+    }
+    while(ring -> count == 0)
+        pthread_cond_wait(&ring -> produced, &ring -> mutex);
+    ring -> held = TRUE;
+    pthread_mutex_unlock(&ring -> mutex);
+
+    return b;
+}
+
+/**
+ * [io61_zip_wrbuf returns the buffer a compressed writer is writing to, handing a full one to
+ *                 the helper thread first]
+ * @param  ring [ring of a compressed writer]
+ * @return      [buffer with free space, or NULL if the helper thread reported an error]
+ */
+zipbuf* io61_zip_wrbuf(zipring* ring)
+{
+    zipbuf* b = &ring -> bufs[ring -> prod];
+
+    if(b -> len < ZIPBLOCK)
+        return b;
+
+    pthread_mutex_lock(&ring -> mutex);
+    ring -> prod = (ring -> prod + 1) % ring -> nbufs;
+    ring -> count++;
+    pthread_cond_signal(&ring -> produced);
+    while(ring -> count == ring -> nbufs)
+        pthread_cond_wait(&ring -> consumed, &ring -> mutex);
+    b = ring -> error ? NULL : &ring -> bufs[ring -> prod];
+    pthread_mutex_unlock(&ring -> mutex);
+
+    return b;
+}
+
+/**
+ * [io61_zip_readc io61_readc for compressed readers in sequential mode]
+ * @param  f [file]
+ * @return   [character read, or EOF on error or end-of-file]
+ */
+int io61_zip_readc(io61_file* f)
+{
+    zipbuf* b = io61_zip_rdbuf(f -> zip);
+    if(b -> len <= 0)
+        return EOF;
+
+    return (unsigned char) b -> data[ b -> offset++ ];
+}
+
+/**
+ * [io61_zip_read io61_read for compressed readers in sequential mode]
+ * @param  f   [file]
+ * @param  buf [destination]
+ * @param  sz  [number of bytes requested]
+ * @return     [number of bytes read; short only at end-of-file or on error;
+ *              -1 if an error occurred before any bytes were read]
+ */
+ssize_t io61_zip_read(io61_file* f, char* buf, size_t sz)
+{
+    size_t nread = 0;
+
+    while(nread < sz)
+    {
+        zipbuf* b = io61_zip_rdbuf(f -> zip);
+        if(b -> len <= 0)
+        {
+            if(b -> len < 0 && nread == 0)
+                return FAIL;
+            break;
+        }
+
+        size_t n = b -> len - b -> offset;
+        if(n > sz - nread)
+            n = sz - nread;
+        memcpy(buf + nread, b -> data + b -> offset, n);
+        b -> offset += n;
+        nread += n;
+    }
+
+    return nread;
+}
+
+/**
+ * [io61_zip_writec io61_writec for compressed writers]
+ * @param  f  [file]
+ * @param  ch [character to write]
+ * @return    [0 on success, -1 if the helper thread reported an error]
+ */
+int io61_zip_writec(io61_file* f, int ch)
+{
+    zipbuf* b = io61_zip_wrbuf(f -> zip);
+    if(b == NULL)
+        return FAIL;
+
+    b -> data[ b -> len++ ] = ch;
+    f -> zip -> rawpos++;
+    return SUCCESS;
+}
+
+/**
+ * [io61_zip_write io61_write for compressed writers]
+ * @param  f   [file]
+ * @param  buf [source]
+ * @param  sz  [number of bytes to write]
+ * @return     [number of bytes written, normally `sz`;
+ *              -1 if the helper thread reported an error before any bytes were written]
+ */
+ssize_t io61_zip_write(io61_file* f, const char* buf, size_t sz)
+{
+    size_t nwritten = 0;
+
+    while(nwritten < sz)
+    {
+        zipbuf* b = io61_zip_wrbuf(f -> zip);
+        if(b == NULL)
+            return nwritten ? (ssize_t) nwritten : FAIL;
+
+        size_t n = ZIPBLOCK - b -> len;
+        if(n > sz - nwritten)
+            n = sz - nwritten;
+        memcpy(b -> data + b -> len, buf + nwritten, n);
+        b -> len += n;
+        nwritten += n;
+    }
+    f -> zip -> rawpos += nwritten;
+
+    return nwritten;
+}
+
+/**
+ * [io61_zip_flush hands the partially filled buffer of a compressed writer to the helper
+ *                 thread, as a short frame, and waits until every queued frame is written]
+ * @param  f [file]
+ * @return   [0 on success, -1 if the helper thread reported an error]
+ */
+int io61_zip_flush(io61_file* f)
+{
+    zipring* ring = f -> zip;
+    if(f -> mode == O_RDONLY || ring -> nbufs == 0)
+        return ring -> error ? FAIL : SUCCESS;
+
+    pthread_mutex_lock(&ring -> mutex);
+    if(ring -> bufs[ring -> prod].len > 0)
+    {
+        while(ring -> count == ring -> nbufs)
+            pthread_cond_wait(&ring -> consumed, &ring -> mutex);
+        ring -> prod = (ring -> prod + 1) % ring -> nbufs;
+        ring -> count++;
+        pthread_cond_signal(&ring -> produced);
+    }
+    while(ring -> count > 0)
+        pthread_cond_wait(&ring -> consumed, &ring -> mutex);
+    int r = ring -> error ? FAIL : SUCCESS;
+    pthread_mutex_unlock(&ring -> mutex);
+
+    return r;
+}
+
+/**
+ * [io61_zip_seek io61_seek for compressed streams. A reader stays sequential when `pos` is in
+ *                a frame the helper thread already decompressed. Any other seek needs the
+ *                frame index: the helper thread stops and, like a plain file, the reader goes
+ *                on through the block cache, where io61_zip_loadblock decompresses frames
+ *                on a miss. Writers only write in order.]
+ * @param  f   [file]
+ * @param  pos [raw offset]
+ * @return     [0 on success; -1 with errno ESPIPE if `f` is a writer, or a reader without
+ *              an index, and `pos` is not the current position]
+ */
+int io61_zip_seek(io61_file* f, size_t pos)
+{
+    zipring* ring = f -> zip;
+    if(f -> mode != O_RDONLY)
+    {
+        if((off_t) pos == ring -> rawpos)
+            return SUCCESS;
+        errno = ESPIPE;
+        return FAIL;
+    }
+
+    if(f -> seq)
+    {
+        pthread_mutex_lock(&ring -> mutex);
+        off_t cur = ring -> rawpos;
+        for(int k = 0; k < ring -> count; k++)
+        {
+            zipbuf* b = &ring -> bufs[(ring -> cons + k) % ring -> nbufs];
+            if(k == 0)
+                cur = b -> rawpos + b -> offset;
+            if(b -> len > 0 && (off_t) pos >= b -> rawpos && (off_t) pos < b -> rawpos + b -> len)
+            {
+                // the frames before it are passed over
+                ring -> cons = (ring -> cons + k) % ring -> nbufs;
+                ring -> count -= k;
+                ring -> held = TRUE;
+                b -> offset = pos - b -> rawpos;
+                if(k > 0)
+                    pthread_cond_signal(&ring -> consumed);
+                cur = pos;
+                break;
+            }
+        }
+        pthread_mutex_unlock(&ring -> mutex);
+        if((off_t) pos == cur)
+            return SUCCESS;
+
+        if(ring -> frames == NULL)
+        {
+            errno = ESPIPE;
+            return FAIL;
+        }
+        io61_zip_stop(f);
+        f -> seq = FALSE;
+    }
+
+    f -> pos = pos;
+    return SUCCESS;
+}
+
+/**
+ * [io61_zip_loadblock brings block `pos` of the compressed reader `f` into the cache after a
+ *                     read missed it. The frames that hold the block are read and decompressed
+ *                     (one, unless a flush cut a short frame), and the other whole blocks of
+ *                     those frames are cached too, since the work to get them is done.]
+ * @param  f   [file; its shard is locked, and is again on return]
+ * @param  pos [block-aligned raw position]
+ * @return     [index of the cache slot of block `pos`, or -1 if it could not be read]
+ */
+int io61_zip_loadblock(io61_file* f, off_t pos)
+{
+    zipring* ring = f -> zip;
+    pthread_mutex_unlock(&f -> shard -> lock);
+    if(ring -> raw == NULL)
+    {
+        ring -> raw = (char*) malloc(ZIPBLOCK);
+        if(ring -> raw == NULL)
+        {
+            pthread_mutex_lock(&f -> shard -> lock);
+            errno = ENOMEM;
+            return FAIL;
+        }
+        ring -> mem += ZIPBLOCK;
+        io61_memadd(ZIPBLOCK);
+        io61_fileadd(f, ZIPBLOCK);
+    }
+
+    int i = io61_claimslot(f);
+    if(i < 0)
+    {
+        pthread_mutex_lock(&f -> shard -> lock);
+        return FAIL;
+    }
+    cache[i].bufsize = 0;
+    cache[i].dirtylo = cache[i].dirtyhi = 0;
+    f -> stats.misses++;
+
+    // last frame that starts at or before `pos`; past the end, the sentinel
+    size_t lo = 0, hi = ring -> nframes;
+    while(lo < hi)
+    {
+        size_t mid = (lo + hi + 1) / 2;
+        if(ring -> frames[mid].rawpos <= pos)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+
+    for(size_t k = lo; k < ring -> nframes && ring -> frames[k].rawpos < pos + BUFSIZE; k++)
+    {
+        size_t n = ring -> frames[k + 1].zpos - ring -> frames[k].zpos;
+        ssize_t len = FAIL;
+        if(n >= ZIPFRAME && n <= ZIPFRAME + ZIPBLOCK
+           && io61_zip_readall(f, ring, ring -> zdata, n, ring -> frames[k].zpos) == (ssize_t) n)
+            len = io61_zip_unpack(ring -> zdata, n, ring -> raw);
+        if(len <= 0)
+        {
+            io61_freeslot(i);
+            pthread_mutex_lock(&f -> shard -> lock);
+            return FAIL;
+        }
+
+        off_t start = ring -> frames[k].rawpos;
+        off_t end = start + len;
+        for(off_t b = start - start % BUFSIZE; b < end; b += BUFSIZE)
+        {
+            off_t blockend = b + BUFSIZE < ring -> rawsize ? b + BUFSIZE : ring -> rawsize;
+            if(b == pos)
+            {
+                // the part of the block this frame holds
+                off_t from = b > start ? b : start;
+                off_t to = blockend < end ? blockend : end;
+                memcpy(cache[i].data + (from - b), ring -> raw + (from - start), to - from);
+                cache[i].bufsize = to - b;
+            }else if(b >= start && blockend <= end)
+            {
+                // only this thread adds blocks of `f`, so the block cannot appear meanwhile
+                pthread_mutex_lock(&f -> shard -> lock);
+                int cached = io61_findblock(f, b) >= 0;
+                pthread_mutex_unlock(&f -> shard -> lock);
+                if(cached)
+                    continue;
+
+                // the neighbours are a bonus: without a slot they are just not cached
+                int j = io61_claimslot(f);
+                if(j < 0)
+                    continue;
+                memcpy(cache[j].data, ring -> raw + (b - start), blockend - b);
+                cache[j].bufsize = blockend - b;
+                cache[j].dirtylo = cache[j].dirtyhi = 0;
+                pthread_mutex_lock(&f -> shard -> lock);
+                io61_insertblock(f, j, b);
+                pthread_mutex_unlock(&f -> shard -> lock);
+            }
+        }
+    }
+
+    pthread_mutex_lock(&f -> shard -> lock);
+    io61_insertblock(f, i, pos);
+    return i;
+}
+
+/**
+ * [io61_lz_compress compresses `n` bytes into an LZ4-style block: sequences of a token (literal
+ *                   and match length nibbles), extra length bytes, literals, and a two-byte
+ *                   match offset, ending with literals only. Matches are found greedily through
+ *                   a hash table of 4-byte prefixes, with a growing step across data that does
+ *                   not match.]
+ * @param  src   [raw bytes]
+ * @param  n     [number of raw bytes, at most 64KB]
+ * @param  dst   [destination]
+ * @param  cap   [bytes at `dst`]
+ * @param  table [1 << ZIPHASHLOG positions, left over from earlier blocks or zero]
+ * @return       [compressed size, or 0 if it does not fit in `cap`]
+ */
+size_t io61_lz_compress(const char* src, size_t n, char* dst, size_t cap, uint16_t* table)
+{
+    const unsigned char* in = (const unsigned char*) src;
+    const unsigned char* end = in + n;
+    const unsigned char* ip = in;
+    const unsigned char* anchor = in;
+    unsigned char* out = (unsigned char*) dst;
+    unsigned char* op = out;
+    unsigned char* oend = out + cap;
+
+    // matches start at least 12 bytes, and end at least 5 bytes, before the end
+    const unsigned char* mflimit = n > 12 ? end - 12 : in;
+    const unsigned char* matchlimit = end - 5;
+
+    while(ip < mflimit)
+    {
+        uint32_t seq;
+        memcpy(&seq, ip, 4);
+        uint32_t h = (seq * 2654435761u) >> (32 - ZIPHASHLOG);
+        const unsigned char* ref = in + table[h];
+        table[h] = ip - in;
+
+        uint32_t old;
+        if(ref >= ip || (memcpy(&old, ref, 4), old != seq))
+        {
+            ip += 1 + ((ip - anchor) >> 6);
+            continue;
+        }
+        while(ip > anchor && ref > in && ip[-1] == ref[-1])
+        {
+            ip--;
+            ref--;
+        }
+        const unsigned char* mp = ip + 4;
+        const unsigned char* rp = ref + 4;
+        while(mp < matchlimit && *mp == *rp)
+        {
+            mp++;
+            rp++;
+        }
+
+        size_t lit = ip - anchor;
+        size_t mlen = mp - ip - 4;
+        if((size_t) (oend - op) < lit + lit / 255 + mlen / 255 + 5)
+            return 0;
+        unsigned char* token = op++;
+        *token = (lit < 15 ? lit : 15) << 4;
+        if(lit >= 15)
+        {
+            size_t l = lit - 15;
+            for(; l >= 255; l -= 255)
+                *op++ = 255;
+            *op++ = l;
+        }
+        if(lit <= 16 && oend - op >= 16 && end - anchor >= 16)
+            memcpy(op, anchor, 16);     // short runs are copied in one piece
+        else
+            memcpy(op, anchor, lit);
+        op += lit;
+        size_t off = ip - ref;
+        *op++ = off;
+        *op++ = off >> 8;
+        *token |= mlen < 15 ? mlen : 15;
+        if(mlen >= 15)
+        {
+            size_t l = mlen - 15;
+            for(; l >= 255; l -= 255)
+                *op++ = 255;
+            *op++ = l;
+        }
+        ip = anchor = mp;
+    }
+
+    size_t lit = end - anchor;
+    if((size_t) (oend - op) < lit + lit / 255 + 2)
+        return 0;
+    *op = (lit < 15 ? lit : 15) << 4;
+    op++;
+    if(lit >= 15)
+    {
+        size_t l = lit - 15;
+        for(; l >= 255; l -= 255)
+            *op++ = 255;
+        *op++ = l;
+    }
+    memcpy(op, anchor, lit);
+    op += lit;
+
+    return op - out;
+}
+
+/**
+ * [io61_lz_decompress decompresses a block made by io61_lz_compress. Every length and offset is
+ *                     checked, so a damaged block fails instead of overrunning a buffer.]
+ * @param  src [compressed bytes]
+ * @param  n   [number of compressed bytes]
+ * @param  dst [destination]
+ * @param  cap [bytes at `dst`]
+ * @return     [number of raw bytes, or -1 if the block is damaged]
+ */
+ssize_t io61_lz_decompress(const char* src, size_t n, char* dst, size_t cap)
+{
+    const unsigned char* ip = (const unsigned char*) src;
+    const unsigned char* iend = ip + n;
+    unsigned char* out = (unsigned char*) dst;
+    unsigned char* op = out;
+    unsigned char* oend = out + cap;
+
+    while(ip < iend)
+    {
+        unsigned token = *ip++;
+        size_t lit = token >> 4;
+        if(lit == 15)
+        {
+            unsigned b;
+            do
+            {
+                if(ip == iend)
+                    return FAIL;
+                b = *ip++;
+                lit += b;
+            }while(b == 255);
+        }
+        if(lit > (size_t) (iend - ip) || lit > (size_t) (oend - op))
+            return FAIL;
+        // short runs are copied 16 bytes at a time where both buffers have room for it
+        if(lit <= 16 && iend - ip >= 16 && oend - op >= 16)
+            memcpy(op, ip, 16);
+        else
+            memcpy(op, ip, lit);
+        op += lit;
+        ip += lit;
+        if(ip == iend)
+            break;      // the last sequence has no match
+
+        if(iend - ip < 2)
+            return FAIL;
+        size_t off = ip[0] | (ip[1] << 8);
+        ip += 2;
+        size_t mlen = token & 15;
+        if(mlen == 15)
+        {
+            unsigned b;
+            do
+            {
+                if(ip == iend)
+                    return FAIL;
+                b = *ip++;
+                mlen += b;
+            }while(b == 255);
+        }
+        mlen += 4;
+        if(off == 0 || off > (size_t) (op - out) || mlen > (size_t) (oend - op))
+            return FAIL;
+
+        // an offset shorter than the match repeats the bytes just written
+        const unsigned char* m = op - off;
+        if(off >= 16 && (size_t) (oend - op) >= mlen + 16)
+            for(size_t k = 0; k < mlen; k += 16)
+                memcpy(op + k, m + k, 16);
+        else if(off >= mlen)
+            memcpy(op, m, mlen);
+        else
+            for(size_t k = 0; k < mlen; k++)
+                op[k] = m[k];
+        op += mlen;
+    }
+
+    return op - out;
+}
+
+/**
+ * [io61_put32 stores `v` little-endian at `p`; io61_put64, io61_get32 and io61_get64 likewise
+ *             keep the compressed stream format the same on every host]
+ * @param p [destination]
+ * @param v [value]
+ */
+void io61_put32(unsigned char* p, uint32_t v)
+{
+    for(int k = 0; k < 4; k++)
+        p[k] = v >> (8 * k);
+}
+
+void io61_put64(unsigned char* p, uint64_t v)
+{
+    for(int k = 0; k < 8; k++)
+        p[k] = v >> (8 * k);
+}
+
+uint32_t io61_get32(const unsigned char* p)
+{
+    uint32_t v = 0;
+    for(int k = 3; k >= 0; k--)
+        v = v << 8 | p[k];
+    return v;
+}
+
+uint64_t io61_get64(const unsigned char* p)
+{
+    uint64_t v = 0;
+    for(int k = 7; k >= 0; k--)
+        v = v << 8 | p[k];
+    return v;
+}
+
+/**
+ * [io61_findslot looks up the stream buffer of the sequential file `f`]
+ * @param  f [file]
+ * @return   [index of cache slot, or -1 if `f` has none]
+ */
+int io61_findslot(io61_file* f)
+{
+    return f -> slot;
+}
+
+/**
+ * [io61_turn points the stream buffer of the O_RDWR stream `f` in direction `dir`. Pending
+ *            output is flushed before reading, so a request is out before its reply is awaited.]
+ * @param  f   [file]
+ * @param  dir [O_RDONLY or O_WRONLY]
+ * @return     [0 on success; -1 if the flush failed, or if unread input still holds the buffer]
+ */
+int io61_turn(io61_file* f, int dir)
+{
+    int i = f -> slot;
+    if(f -> dir == dir)
+        return SUCCESS;
+
+    if(dir == O_RDONLY)
+    {
+        if(io61_flush(f) == FAIL)
+            return FAIL;
+        if(i >= 0)
+            cache[i].offset = cache[i].bufsize = 0;
+    }else
+    {
+        if(i >= 0 && cache[i].offset < cache[i].bufsize)
+            return FAIL;
+        if(i >= 0)
+        {
+            cache[i].offset = 0;
+            cache[i].bufsize = f -> bufcap;
+        }
+    }
+
+    f -> dir = dir;
+    return SUCCESS;
+}
+
+/**
+ * [io61_writev_all writes every byte described by `iov` to `f`, retrying short writes.
+ *                  `iov` is modified to track progress.]
+ * @param  f      [file]
+ * @param  iov    [fragments]
+ * @param  iovcnt [number of fragments]
+ * @return        [number of bytes written; -1 if an error occurred before any bytes were written]
+ */
+ssize_t io61_writev_all(io61_file* f, struct iovec* iov, int iovcnt)
+{
+    size_t nwritten = 0;
+
+    while(iovcnt > 0)
+    {
+        long long start = io61_clock();
+        ssize_t n = writev(f -> fd, iov, iovcnt < IOV_MAX ? iovcnt : IOV_MAX);
+        io61_count(f, SYS_WRITEV, start, n);
+        io61_crcaddv(f, O_WRONLY, iov, iovcnt < IOV_MAX ? iovcnt : IOV_MAX, n);
+        if(n == -1 && errno == EINTR)
+            continue;
+        if(n <= 0)
+            return nwritten ? (ssize_t) nwritten : FAIL;
+        nwritten += n;
+
+        while(iovcnt > 0 && (size_t) n >= iov -> iov_len)
+        {
+            n -= iov -> iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if(iovcnt > 0)
+        {
+            iov -> iov_base = (char*) iov -> iov_base + n;
+            iov -> iov_len -= n;
+        }
+    }
+
+    return nwritten;
+}
+
+/**
+ * [io61_fill refills the stream buffer `i` of the sequential reader `f`. A direct reader
+ *            reads a whole buffer from the page boundary at or below `pos` and skips the
+ *            bytes before `pos`.]
+ * @param  f [file]
+ * @param  i [index of cache slot]
+ * @return   [number of new bytes in the buffer; 0 at end of file; -1 on error]
+ */
+ssize_t io61_fill(io61_file* f, int i)
+{
+    return io61_refill(f, i, 0);
+}
+
+/**
+ * [io61_refill refills the stream buffer `i` of the sequential reader `f` like io61_fill, but
+ *              first moves the `keep` unread bytes to the front of the buffer, so the new bytes
+ *              continue them. Direct readers cannot keep bytes.]
+ * @param  f    [file]
+ * @param  i    [index of cache slot]
+ * @param  keep [unread bytes left in the buffer, less than its capacity]
+ * @return      [number of new bytes in the buffer; 0 at end of file; -1 on error]
+ */
+ssize_t io61_refill(io61_file* f, int i, size_t keep)
+{
+    ssize_t n;
+    size_t skip = 0;
+
+    f -> stats.misses++;
+    io61_streambuf(f, i);
+    if(f -> direct)
+    {
+        skip = f -> pos % PAGESIZE;
+        do
+        {
+            long long start = io61_clock();
+            n = pread(f -> fd, cache[i].data, f -> bufcap, f -> pos - skip);
+            io61_count(f, SYS_PREAD, start, n);
+        }while(n == -1 && errno == EINTR);
+    }else
+    {
+        // a tuned-down buffer may be smaller than the bytes to keep; its slot is not
+        size_t size = f -> bufcap > keep ? f -> bufcap : cache[i].cap;
+        long long ns;
+        memmove(cache[i].data, &cache[i].data[ cache[i].offset ], keep);
+        do
+        {
+            long long start = io61_clock();
+            n = read(f -> fd, &cache[i].data[keep], size - keep);
+            ns = io61_count(f, SYS_READ, start, n);
+        }while(n == -1 && errno == EINTR);
+        io61_crcadd(f, O_RDONLY, &cache[i].data[keep], n);
+        if(n > 0)
+            io61_tune(f, n, ns);
+    }
+
+    if(n <= (ssize_t) skip)
+    {
+        cache[i].offset = 0;
+        cache[i].bufsize = keep;
+        return n < 0 ? FAIL : 0;
+    }
+
+    if(f -> direct)
+        f -> pos += n - skip;
+    cache[i].offset = skip;
+    cache[i].bufsize = keep + n;
+    f -> stats.hitbytes += n - skip;
+    return n - skip;
+}
+
+/**
+ * [io61_pwrite_all writes `len` bytes of `buf` to `f` at `pos`, retrying short writes]
+ * @param  f   [file]
+ * @param  buf [bytes to write]
+ * @param  len [number of bytes]
+ * @param  pos [file position]
+ * @return     [0 on success, -1 on failure]
+ */
+int io61_pwrite_all(io61_file* f, const char* buf, size_t len, off_t pos)
+{
+    while(len > 0)
+    {
+        long long start = io61_clock();
+        ssize_t n = pwrite(f -> fd, buf, len, pos);
+        io61_count(f, SYS_PWRITE, start, n);
+        if(n == -1 && errno == EINTR)
+            continue;
+        if(n <= 0)
+            return FAIL;
+        buf += n;
+        len -= n;
+        pos += n;
+    }
+
+    return SUCCESS;
+}
+
+/**
+ * [io61_pwrite_buffered writes through the page cache to the O_DIRECT file `f`, for
+ *                       pieces that are not page-aligned. The flag is cleared for the call.]
+ * @param  f   [file]
+ * @param  buf [bytes to write]
+ * @param  len [number of bytes]
+ * @param  pos [file position]
+ * @return     [0 on success, -1 on failure]
+ */
+int io61_pwrite_buffered(io61_file* f, const char* buf, size_t len, off_t pos)
+{
+    int fl = fcntl(f -> fd, F_GETFL);
+    if(fl == -1 || fcntl(f -> fd, F_SETFL, fl & ~O_DIRECT) == -1)
+        return FAIL;
+
+    int r = io61_pwrite_all(f, buf, len, pos);
+
+    if(fcntl(f -> fd, F_SETFL, fl) == -1)
+        r = FAIL;
+    return r;
+}
+
+/**
+ * [io61_pwrite_direct writes `len` bytes of `buf` to the O_DIRECT file `f` at `pos`.
+ *                     The page-aligned middle goes straight to the device; an unaligned
+ *                     head and tail go through the page cache.]
+ * @param  f   [file]
+ * @param  buf [bytes to write]
+ * @param  len [number of bytes]
+ * @param  pos [file position]
+ * @return     [0 on success, -1 on failure]
+ */
+int io61_pwrite_direct(io61_file* f, const char* buf, size_t len, off_t pos)
+{
+    size_t head = (PAGESIZE - pos % PAGESIZE) % PAGESIZE;
+    if(head > len)
+        head = len;
+    size_t mid = (len - head) - (len - head) % PAGESIZE;
+
+    // the memory must be aligned like the file position
+    if((unsigned long) (buf + head) % PAGESIZE != 0)
+    {
+        head = len;
+        mid = 0;
+    }
+    size_t tail = len - head - mid;
+
+    if(head > 0 && io61_pwrite_buffered(f, buf, head, pos) == FAIL)
+        return FAIL;
+    if(mid > 0 && io61_pwrite_all(f, buf + head, mid, pos + head) == FAIL)
+        return FAIL;
+    if(tail > 0 && io61_pwrite_buffered(f, buf + head + mid, tail, pos + head + mid) == FAIL)
+        return FAIL;
+
+    return SUCCESS;
+}
+
+/**
+ * [io61_writev writes the `iovcnt` fragments of `iov` to `f`, in order. A batch that fits
+ *              in the buffer is copied there; otherwise the buffered bytes and every fragment
+ *              go to the kernel in a single writev, without copying the fragments.]
+ * @param  f      [file]
+ * @param  iov    [fragments]
+ * @param  iovcnt [number of fragments]
+ * @return        [number of bytes written, normally the sum of the fragment lengths;
+ *                 -1 if an error occurred before any bytes were written]
+ */
+ssize_t io61_writev(io61_file* f, const struct iovec* iov, int iovcnt)
+{
+    size_t total = 0;
+    for(int k = 0; k < iovcnt; k++)
+        total += iov[k].iov_len;
+
+    if(f -> async || f -> uring || f -> zip || f -> seq == FALSE)
+    {
+        // these modes buffer every write anyway
+        size_t nwritten = 0;
+        for(int k = 0; k < iovcnt; k++)
+        {
+            ssize_t n = io61_write(f, (const char*) iov[k].iov_base, iov[k].iov_len);
+            if(n < 0)
+                return nwritten ? (ssize_t) nwritten : FAIL;
+            nwritten += n;
+        }
+        return nwritten;
+    }
+
+    if(f -> mode == O_RDWR && io61_turn(f, O_WRONLY) == FAIL)
+    {
+        // unread input holds the buffer, so these bytes go out unbuffered
+        struct iovec small[IOVSTACK];
+        struct iovec* kiov = iovcnt <= IOVSTACK ? small : (struct iovec*) malloc(iovcnt * sizeof(struct iovec));
+        if(kiov == NULL)
+        {
+            errno = ENOMEM;
+            return FAIL;
+        }
+        memcpy(kiov, iov, iovcnt * sizeof(struct iovec));
+        f -> stats.misses++;
+        ssize_t r = io61_writev_all(f, kiov, iovcnt);
+        if(kiov != small)
+            free(kiov);
+        return r;
+    }
+
+    int i = io61_findslot(f);
+    size_t buffered = i >= 0 ? cache[i].offset : 0;
+
+    if(f -> direct)
+    {
+        // user memory is not aligned: everything goes through the stream buffer
+        if(i < 0)
+            i = io61_getslot(f);
+        if(i < 0)
+            return FAIL;
+        for(int k = 0; k < iovcnt; k++)
+        {
+            size_t done = 0;
+            while(done < iov[k].iov_len)
+            {
+                if(cache[i].offset == cache[i].bufsize && io61_flush(f) == FAIL)
+                    return FAIL;
+                size_t n = cache[i].bufsize - cache[i].offset;
+                if(n > iov[k].iov_len - done)
+                    n = iov[k].iov_len - done;
+                memcpy(&cache[i].data[ cache[i].offset ], (const char*) iov[k].iov_base + done, n);
+                cache[i].offset += n;
+                done += n;
+            }
+        }
+        return total;
+    }
+
+    if(buffered + total <= (i >= 0 ? cache[i].bufsize : f -> bufcap))
+    {
+        if(i < 0)
+            i = io61_getslot(f);
+        if(i < 0)
+            return FAIL;
+        for(int k = 0; k < iovcnt; k++)
+        {
+            memcpy(&cache[i].data[ cache[i].offset ], iov[k].iov_base, iov[k].iov_len);
+            cache[i].offset += iov[k].iov_len;
+        }
+        if(f -> msg && io61_msgcheck(f) == FAIL)
+            return FAIL;
+        return total;
+    }
+
+    struct iovec small[IOVSTACK + 1];
+    struct iovec* kiov = iovcnt <= IOVSTACK ? small : (struct iovec*) malloc((iovcnt + 1) * sizeof(struct iovec));
+    if(kiov == NULL)
+    {
+        errno = ENOMEM;
+        return FAIL;
+    }
+    int n = 0;
+    if(buffered > 0)
+    {
+        kiov[n].iov_base = cache[i].data;
+        kiov[n++].iov_len = buffered;
+    }
+    memcpy(&kiov[n], iov, iovcnt * sizeof(struct iovec));
+
+    f -> stats.misses++;
+    ssize_t r = io61_writev_all(f, kiov, n + iovcnt);
+    if(kiov != small)
+        free(kiov);
+
+    if(r < 0 || (size_t) r < buffered)
+        return FAIL;
+    f -> stats.hitbytes += buffered;
+    if(i >= 0)
+        cache[i].offset = 0;
+    f -> msgstamped = FALSE;
+    if(f -> durable && io61_durablecheck(f) == FAIL)
+        return FAIL;
+    return r - buffered;
+}
+
+/**
+ * [io61_readv reads into the `iovcnt` fragments of `iov` from `f`, in order. Buffered bytes
+ *             are copied out first; the rest is read with readv straight into the fragments.
+ *             If less than a buffer remains, the cache slot is appended as a last fragment
+ *             to catch read-ahead.]
+ * @param  f      [file]
+ * @param  iov    [fragments]
+ * @param  iovcnt [number of fragments]
+ * @return        [number of bytes read, normally the sum of the fragment lengths; short at
+ *                 end of file; -1 if an error occurred before any bytes were read]
+ */
+ssize_t io61_readv(io61_file* f, const struct iovec* iov, int iovcnt)
+{
+    size_t nread = 0;
+
+    if(f -> async || f -> uring || f -> zip || f -> seq == FALSE)
+    {
+        for(int k = 0; k < iovcnt; k++)
+        {
+            ssize_t n = io61_read(f, (char*) iov[k].iov_base, iov[k].iov_len);
+            if(n < 0)
+                return nread ? (ssize_t) nread : FAIL;
+            nread += n;
+            if((size_t) n < iov[k].iov_len)
+                break;
+        }
+        return nread;
+    }
+    if(f -> mode == O_RDWR && io61_turn(f, O_RDONLY) == FAIL)
+        return FAIL;
+
+    // the copy has room for the read-ahead fragment
+    struct iovec small[IOVSTACK + 1];
+    struct iovec* kiov = iovcnt <= IOVSTACK ? small : (struct iovec*) malloc((iovcnt + 1) * sizeof(struct iovec));
+    if(kiov == NULL)
+    {
+        errno = ENOMEM;
+        return FAIL;
+    }
+    memcpy(kiov, iov, iovcnt * sizeof(struct iovec));
+    struct iovec* cur = kiov;
+    int left = iovcnt;
+
+    int i = io61_findslot(f);
+    if(i < 0)
+    {
+        i = io61_getslot(f);
+        if(i < 0)
+        {
+            if(kiov != small)
+                free(kiov);
+            return FAIL;
+        }
+        cache[i].bufsize = 0;
+    }
+    while(1)
+    {
+        // serve whatever the buffer holds
+        while(left > 0 && cache[i].offset < cache[i].bufsize)
+        {
+            size_t n = cache[i].bufsize - cache[i].offset;
+            if(n > cur -> iov_len)
+                n = cur -> iov_len;
+            memcpy(cur -> iov_base, &cache[i].data[ cache[i].offset ], n);
+            cache[i].offset += n;
+            nread += n;
+            cur -> iov_base = (char*) cur -> iov_base + n;
+            cur -> iov_len -= n;
+            if(cur -> iov_len == 0)
+            {
+                cur++;
+                left--;
+            }
+        }
+        while(left > 0 && cur -> iov_len == 0)
+        {
+            cur++;
+            left--;
+        }
+        if(left == 0)
+            break;
+
+        if(f -> direct)
+        {
+            // user memory is not aligned: refill the stream buffer and copy
+            ssize_t r = io61_fill(f, i);
+            if(r <= 0)
+            {
+                if(kiov != small)
+                    free(kiov);
+                return nread ? (ssize_t) nread : (r == 0 ? 0 : FAIL);
+            }
+            continue;
+        }
+
+        // the buffer is empty: read the remaining fragments plus a buffer's worth of read-ahead
+        if(f -> msg)
+            io61_msgwait(f);
+        size_t wanted = 0;
+        for(int k = 0; k < left; k++)
+            wanted += cur[k].iov_len;
+        int cnt = left;
+        if(wanted < f -> bufcap)
+        {
+            io61_streambuf(f, i);
+            cur[left].iov_base = cache[i].data;
+            cur[left].iov_len = f -> bufcap;
+            cnt++;
+        }
+        if(cnt > IOV_MAX)
+            cnt = IOV_MAX;
+
+        f -> stats.misses++;
+        long long start = io61_clock();
+        ssize_t r = readv(f -> fd, cur, cnt);
+        io61_count(f, SYS_READV, start, r);
+        io61_crcaddv(f, O_RDONLY, cur, cnt, r);
+        if(r == -1 && errno == EINTR)
+            continue;
+        if(r <= 0)
+        {
+            if(kiov != small)
+                free(kiov);
+            return nread ? (ssize_t) nread : (r == 0 ? 0 : FAIL);
+        }
+
+        if(cnt == left + 1 && (size_t) r > wanted)
+        {
+            // the fragments are full, the excess landed in the buffer
+            cache[i].offset = 0;
+            cache[i].bufsize = r - wanted;
+            f -> stats.hitbytes += r - wanted;
+            nread += wanted;
+            break;
+        }
+
+        cache[i].offset = cache[i].bufsize = 0;
+        nread += r;
+        while(left > 0 && (size_t) r >= cur -> iov_len)
+        {
+            r -= cur -> iov_len;
+            cur++;
+            left--;
+        }
+        if(left == 0)
+            break;
+        cur -> iov_base = (char*) cur -> iov_base + r;
+        cur -> iov_len -= r;
+    }
+
+    if(kiov != small)
+        free(kiov);
+    return nread;
+}
+
+/**
+ * [io61_copy copies up to `len` bytes from `inf` to `outf`, stopping early at end of file.
+ *            When both ends are plain descriptors the kernel moves the data itself with
+ *            copy_file_range (file to file), sendfile (file to anything) or splice (pipes),
+ *            so it never passes through user space; otherwise it falls back to a
+ *            buffered read/write loop. Pass (size_t) -1 to copy the whole input.
+ *            A large file-to-file copy is split among threads (see io61_copy_threads).]
+ * @param  inf  [file to read from]
+ * @param  outf [file to write to]
+ * @param  len  [maximum number of bytes to copy]
+ * @return      [number of bytes copied; -1 if an error occurred before any bytes were copied]
+ */
+ssize_t io61_copy(io61_file* inf, io61_file* outf, size_t len)
+{
+    char buf[BUFSIZE];
+    size_t ncopied = 0;
+    int method = COPY_BUFFERED;
+
+    if(inf -> async == NULL && inf -> uring == NULL && inf -> zip == NULL && inf -> seq && !inf -> direct
+       && !inf -> crc && outf -> async == NULL && outf -> uring == NULL && outf -> zip == NULL
+       && outf -> seq && !outf -> direct && !outf -> crc)
+    {
+        // bytes io61 has already read from `inf` go out first...
+        int i = io61_findslot(inf);
+        if(i >= 0 && inf -> dir == O_RDONLY && cache[i].offset < cache[i].bufsize)
+        {
+            size_t n = cache[i].bufsize - cache[i].offset;
+            if(n > len)
+                n = len;
+            // a cache block can be larger than `buf`
+            while(ncopied < n)
+            {
+                size_t chunk = n - ncopied;
+                if(chunk > sizeof(buf))
+                    chunk = sizeof(buf);
+                ssize_t r = io61_read(inf, buf, chunk);
+                ssize_t w = r > 0 ? io61_write(outf, buf, r) : r;
+                if(w > 0)
+                    ncopied += w;
+                if(w <= 0 || w < r)
+                    return ncopied ? (ssize_t) ncopied : FAIL;
+            }
+        }
+
+        // ...and `outf` must be flushed before the kernel appends to its descriptor
+        if(io61_flush(outf) == FAIL)
+            return ncopied ? (ssize_t) ncopied : FAIL;
+
+#ifdef __linux__
+        struct stat sin, sout;
+        if(fstat(inf -> fd, &sin) == 0 && fstat(outf -> fd, &sout) == 0)
+        {
+            // copy_file_range and pwrite cannot place data in an O_APPEND file
+            int append = fcntl(outf -> fd, F_GETFL) & O_APPEND;
+            if(S_ISREG(sin.st_mode) && S_ISREG(sout.st_mode) && !append)
+            {
+                method = COPY_RANGE;
+
+                // one thread keeps a single request in flight; several keep the device queue full
+                int nthreads = io61_copythreads();
+                off_t inpos = lseek(inf -> fd, 0, SEEK_CUR);
+                off_t outpos = lseek(outf -> fd, 0, SEEK_CUR);
+                size_t n = inpos >= 0 && sin.st_size > inpos ? sin.st_size - inpos : 0;
+                if(n > len - ncopied)
+                    n = len - ncopied;
+                if(nthreads > 1 && n >= PCOPYMIN && outpos >= 0)
+                {
+                    ssize_t r = io61_pcopy(inf, outf, inpos, outpos, n, nthreads);
+                    ncopied += r;
+
+                    // the workers used explicit offsets: move both descriptors past the copy
+                    int rin = lseek(inf -> fd, inpos + r, SEEK_SET) == (off_t) -1 ? FAIL : SUCCESS;
+                    int rout = lseek(outf -> fd, outpos + r, SEEK_SET) == (off_t) -1 ? FAIL : SUCCESS;
+                    if(rin == FAIL || rout == FAIL)
+                        return ncopied ? (ssize_t) ncopied : FAIL;
+                }
+            }
+            else if(S_ISREG(sin.st_mode))
+                method = COPY_SENDFILE;
+            else if(S_ISFIFO(sin.st_mode) || S_ISFIFO(sout.st_mode))
+                method = COPY_SPLICE;
+        }
+#endif
+    }
+
+    while(ncopied < len)
+    {
+        size_t chunk = len - ncopied;
+        if(chunk > COPYCHUNK)
+            chunk = COPYCHUNK;
+
+        ssize_t n;
+        long long start = io61_clock();
+        switch(method)
+        {
+#ifdef __linux__
+#ifdef __NR_copy_file_range
+            case COPY_RANGE:
+                n = syscall(__NR_copy_file_range, inf -> fd, NULL, outf -> fd, NULL, chunk, 0);
+                break;
+#endif
+            case COPY_SENDFILE:
+                n = sendfile(outf -> fd, inf -> fd, NULL, chunk);
+                break;
+            case COPY_SPLICE:
+                n = splice(inf -> fd, NULL, outf -> fd, NULL, chunk, SPLICE_F_MOVE);
+                break;
+#endif
+            default:
+                method = COPY_BUFFERED;
+                if(chunk > BUFSIZE)
+                    chunk = BUFSIZE;
+                n = io61_read(inf, buf, chunk);
+                if(n > 0)
+                {
+                    // a short write means `outf` failed part way: the rest of `buf` is lost
+                    ssize_t w = io61_write(outf, buf, n);
+                    if(w >= 0 && w < n)
+                        return ncopied + w ? (ssize_t) (ncopied + w) : FAIL;
+                    n = w;
+                }
+                if(n < 0)
+                    return ncopied ? (ssize_t) ncopied : FAIL;
+                break;
+        }
+
+        if(method != COPY_BUFFERED)
+        {
+            // the kernel moved the bytes: `outf` owns the call, `inf` is read all the same
+            io61_count(outf, SYS_COPY, start, n);
+            if(n > 0)
+                __atomic_fetch_add(&inf -> stats.bytesin, n, __ATOMIC_RELAXED);
+        }
+        if(n == -1 && method != COPY_BUFFERED && errno == EINTR)
+            continue;
+        if(n == -1 && method != COPY_BUFFERED
+           && (errno == EINVAL || errno == ENOSYS || errno == EXDEV || errno == EOPNOTSUPP))
+        {
+            // this pair of descriptors does not support the method; a failed call
+            // copies nothing, so try the next one
+            if(method == COPY_RANGE)
+                method = COPY_SENDFILE;
+            else if(method == COPY_SENDFILE)
+                method = COPY_SPLICE;
+            else
+                method = COPY_BUFFERED;
+            continue;
+        }
+        if(n < 0)
+            return ncopied ? (ssize_t) ncopied : FAIL;
+        if(n == 0)
+            break;
+
+        ncopied += n;
+    }
+
+    return ncopied;
+}
+
+/**
+ * [io61_copy_threads sets how many threads io61_copy uses for a large file-to-file copy]
+ * @param  n [number of threads, 1 to always copy on the calling thread, 0 for the default:
+ *            $IO61_COPYTHREADS, else one per online CPU up to PCOPYTHREADS]
+ * @return   [previous setting]
+ */
+int io61_copy_threads(int n)
+{
+    int old = copythreads;
+    copythreads = n > 0 ? n : 0;
+    return old;
+}
+
+/**
+ * [io61_copythreads number of threads for the next parallel copy]
+ * @return  [at least 1]
+ */
+int io61_copythreads(void)
+{
+    if(copythreads > 0)
+        return copythreads;
+
+    const char* env = getenv("IO61_COPYTHREADS");
+    if(env && atoi(env) > 0)
+        return atoi(env);
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    return ncpu < 1 ? 1 : (ncpu > PCOPYTHREADS ? PCOPYTHREADS : (int) ncpu);
+}
+
+/**
+ * [io61_pcopy copies `len` bytes from offset `inpos` of the regular file `inf` to offset `outpos`
+ *             of the regular file `outf` with `nthreads` threads, the caller included. The file
+ *             offsets of the descriptors are left alone.]
+ * @param  inf      [file to read from]
+ * @param  outf     [file to write to]
+ * @param  inpos    [input offset]
+ * @param  outpos   [output offset]
+ * @param  len      [number of bytes]
+ * @param  nthreads [number of threads]
+ * @return          [number of bytes copied in order from the start: `len`, or less if a range
+ *                   failed or the input ended early]
+ */
+ssize_t io61_pcopy(io61_file* inf, io61_file* outf, off_t inpos, off_t outpos, size_t len, int nthreads)
+{
+    pcopyjob job;
+    job.inf = inf;
+    job.outf = outf;
+    job.inpos = inpos;
+    job.outpos = outpos;
+    job.len = job.end = len;
+    job.next = 0;
+    job.method = COPY_RANGE;
+    pthread_mutex_init(&job.mutex, NULL);
+
+    // no more threads than ranges
+    if((size_t) nthreads > (len + PCOPYRANGE - 1) / PCOPYRANGE)
+        nthreads = (len + PCOPYRANGE - 1) / PCOPYRANGE;
+    pthread_t* workers = (pthread_t*) malloc(nthreads * sizeof(pthread_t));
+    int started = 0;
+    // without room for the thread handles the caller copies every range itself
+    while(workers && started < nthreads - 1
+          && pthread_create(&workers[started], NULL, io61_pcopy_worker, &job) == 0)
+        started++;
+
+    io61_pcopy_worker(&job);
+    for(int k = 0; k < started; k++)
+        pthread_join(workers[k], NULL);
+
+    free(workers);
+    pthread_mutex_destroy(&job.mutex);
+    return job.end;
+}
+
+/**
+ * [io61_pcopy_worker thread body of a parallel copy: claims ranges until none are left]
+ * @param  arg [pcopyjob*]
+ * @return     [NULL]
+ */
+void* io61_pcopy_worker(void* arg)
+{
+    pcopyjob* job = (pcopyjob*) arg;
+    char* buf = NULL;
+
+    while(1)
+    {
+        size_t off = __atomic_fetch_add(&job -> next, PCOPYRANGE, __ATOMIC_RELAXED);
+        if(off >= job -> len || off >= __atomic_load_n(&job -> end, __ATOMIC_RELAXED))
+            break;
+        size_t n = job -> len - off < PCOPYRANGE ? job -> len - off : PCOPYRANGE;
+
+        size_t done = io61_pcopy_range(job, off, n, &buf);
+        if(done < n)
+        {
+            // bytes past a hole in the output do not count, whatever other ranges did
+            pthread_mutex_lock(&job -> mutex);
+            if(off + done < job -> end)
+                job -> end = off + done;
+            pthread_mutex_unlock(&job -> mutex);
+        }
+    }
+
+    if(buf)
+        io61_memadd(-(ssize_t) PCOPYRANGE);
+    free(buf);
+    return NULL;
+}
+
+/**
+ * [io61_pcopy_range copies bytes [off, off + n) of a parallel copy, in the kernel with
+ *                   copy_file_range if the file system allows, else with pread and pwrite
+ *                   through a buffer of the worker]
+ * @param  job [copy]
+ * @param  off [offset of the range in the copy]
+ * @param  n   [bytes in the range]
+ * @param  buf [the worker's buffer, allocated on first use]
+ * @return     [number of bytes copied from the start of the range]
+ */
+size_t io61_pcopy_range(pcopyjob* job, size_t off, size_t n, char** buf)
+{
+    size_t done = 0;
+
+#if defined(__linux__) && defined(__NR_copy_file_range)
+    while(done < n && __atomic_load_n(&job -> method, __ATOMIC_RELAXED) == COPY_RANGE)
+    {
+        loff_t in = job -> inpos + off + done;
+        loff_t out = job -> outpos + off + done;
+        long long start = io61_clock();
+        ssize_t r = syscall(__NR_copy_file_range, job -> inf -> fd, &in, job -> outf -> fd, &out, n - done, 0);
+        io61_count(job -> outf, SYS_COPY, start, r);
+        if(r > 0)
+        {
+            __atomic_fetch_add(&job -> inf -> stats.bytesin, r, __ATOMIC_RELAXED);
+            done += r;
+        }else if(r == 0)
+            return done;        // the input ended early
+        else if(errno == EINVAL || errno == ENOSYS || errno == EXDEV || errno == EOPNOTSUPP)
+            __atomic_store_n(&job -> method, COPY_BUFFERED, __ATOMIC_RELAXED);
+        else if(errno != EINTR)
+            return done;
+    }
+#endif
+
+    if(done < n && *buf == NULL)
+    {
+        if((*buf = (char*) malloc(PCOPYRANGE)) == NULL)
+            return done;
+        io61_memadd(PCOPYRANGE);
+    }
+    while(done < n)
+    {
+        long long start = io61_clock();
+        ssize_t r = pread(job -> inf -> fd, *buf, n - done, job -> inpos + off + done);
+        io61_count(job -> inf, SYS_PREAD, start, r);
+        if(r == -1 && errno == EINTR)
+            continue;
+        if(r <= 0 || io61_pwrite_all(job -> outf, *buf, r, job -> outpos + off + done) == FAIL)
+            return done;
+        done += r;
+    }
+
+    return done;
+}
+
+/**
+ * [io61_sync makes everything written to `f` so far durable: io61's buffers are flushed and
+ *            the file's data is synced with fdatasync]
+ * @param  f [file]
+ * @return   [0 on success, -1 on failure (a pipe or socket cannot be synced)]
+ */
+int io61_sync(io61_file* f)
+{
+    if(io61_flushdata(f) == FAIL)
+        return FAIL;
+    return io61_syncnow(f);
+}
+
+/**
+ * [io61_durable puts the writer `f` in group commit mode. Instead of a sync per write, the
+ *               bytes that reached the kernel are synced together with one fdatasync once
+ *               `bytes` of them are unsynced, or once the oldest has waited `delay_us`
+ *               microseconds. In between, sync_file_range starts writeback of every SYNCKICK
+ *               new bytes, so the batch sync has little left to wait for. The policy is
+ *               applied whenever output reaches the kernel (io61_flush, large writes) and at
+ *               io61_close; io61_sync still syncs at once.]
+ * @param  f        [file]
+ * @param  bytes    [unsynced bytes that trigger a sync; 0 syncs after every flush]
+ * @param  delay_us [age of unsynced bytes that triggers a sync; -1 for no limit]
+ * @return          [0 on success, -1 if `f` is read-only or not a file]
+ */
+int io61_durable(io61_file* f, size_t bytes, long delay_us)
+{
+    struct stat s;
+    if(f -> mode == O_RDONLY || fstat(f -> fd, &s) != 0 || !(S_ISREG(s.st_mode) || S_ISBLK(s.st_mode)))
+    {
+        errno = EINVAL;
+        return FAIL;
+    }
+
+    f -> syncbytes = bytes;
+    f -> syncdelay = delay_us;
+    if(f -> durable == FALSE)
+    {
+        // only bytes written from now on are waiting for a sync
+        f -> durable = TRUE;
+        f -> synced = f -> kicked = __atomic_load_n(&f -> stats.bytesout, __ATOMIC_RELAXED);
+        f -> syncsince = 0;
+    }
+    return SUCCESS;
+}
+
+/**
+ * [io61_durablecheck applies the group commit policy of the durable file `f` after output
+ *                    reached the kernel]
+ * @param  f [file]
+ * @return   [0 on success, -1 if a sync failed]
+ */
+int io61_durablecheck(io61_file* f)
+{
+    unsigned long long out = __atomic_load_n(&f -> stats.bytesout, __ATOMIC_RELAXED);
+    if(out == f -> synced)
+        return SUCCESS;
+
+    long long now = io61_clock();
+    if(f -> syncsince == 0)
+        f -> syncsince = now;
+    if(out - f -> synced >= f -> syncbytes
+       || (f -> syncdelay >= 0 && now - f -> syncsince >= f -> syncdelay * 1000LL))
+        return io61_syncnow(f);
+
+#ifdef SYNC_FILE_RANGE_WRITE
+    if(out - f -> kicked >= SYNCKICK)
+    {
+        // start writeback of the dirty pages without waiting for it
+        long long start = io61_clock();
+        int r = sync_file_range(f -> fd, 0, 0, SYNC_FILE_RANGE_WRITE);
+        io61_count(f, SYS_SYNCRANGE, start, r);
+        f -> kicked = out;
+    }
+#endif
+    return SUCCESS;
+}
+
+/**
+ * [io61_syncnow syncs the data `f` has written to the kernel]
+ * @param  f [file]
+ * @return   [0 on success, -1 on failure]
+ */
+int io61_syncnow(io61_file* f)
+{
+    unsigned long long out = __atomic_load_n(&f -> stats.bytesout, __ATOMIC_RELAXED);
+    int r;
+    do
+    {
+        long long start = io61_clock();
+        r = fdatasync(f -> fd);
+        io61_count(f, SYS_SYNC, start, r);
+    }while(r == -1 && errno == EINTR);
+    if(r == -1)
+        return FAIL;
+
+    f -> synced = f -> kicked = out;
+    f -> syncsince = 0;
+    return SUCCESS;
+}
+
+/**
+ * [io61_crc_start puts `f` in integrity mode: every byte read from or written to its descriptor
+ *                 is added, in order, to a CRC32C of its direction. A stream that leaves
+ *                 sequential order (a seek) drops out of the mode. If `f` is a regular file
+ *                 at offset 0, a sidecar holds the checksum and length of its data: a writer
+ *                 records them at io61_close, and a reader that read to the end of the file
+ *                 checks them there, failing the close with EIO on a mismatch.]
+ * @param  f       [sequential file, before any data is read or written]
+ * @param  sidecar [sidecar path; NULL for the file's own name (Linux) with CRCSUFFIX appended]
+ * @return         [0 on success; -1 if `f` is random access, compressed, direct or uses
+ *                  io_uring]
+ */
+int io61_crc_start(io61_file* f, const char* sidecar)
+{
+    if(f -> seq == FALSE || f -> zip || f -> direct || f -> uring)
+    {
+        errno = EINVAL;
+        return FAIL;
+    }
+    pthread_once(&crconce, io61_crcinit);
+    f -> crc = TRUE;
+
+    struct stat s;
+    if(f -> crcpath || f -> mode == O_RDWR || fstat(f -> fd, &s) != 0 || !S_ISREG(s.st_mode)
+       || lseek(f -> fd, 0, SEEK_CUR) != 0)
+        return SUCCESS;
+    if(sidecar)
+        f -> crcpath = strdup(sidecar);
+#ifdef __linux__
+    else
+    {
+        char link[64], path[PATH_MAX];
+        snprintf(link, sizeof(link), "/proc/self/fd/%d", f -> fd);
+        ssize_t n = readlink(link, path, sizeof(path) - strlen(CRCSUFFIX) - 1);
+        if(n > 0 && path[0] == '/')
+        {
+            strcpy(path + n, CRCSUFFIX);
+            f -> crcpath = strdup(path);
+        }
+    }
+#endif
+    return SUCCESS;
+}
+
+/**
+ * [io61_crc returns the CRC32C of the bytes that crossed the descriptor of `f` in direction
+ *           `dir`. Buffered output is not included until it is flushed; an async reader's
+ *           value includes its read-ahead.]
+ * @param  f   [file in integrity mode]
+ * @param  dir [O_RDONLY for the bytes read, O_WRONLY for the bytes written]
+ * @return     [checksum; 0 for no bytes]
+ */
+unsigned io61_crc(io61_file* f, int dir)
+{
+    return dir == O_WRONLY ? f -> crcout : f -> crcin;
+}
+
+/**
+ * [io61_crcadd adds `n` bytes that crossed the descriptor of `f` in direction `dir` to its
+ *              checksum. A read of 0 bytes marks the end of the input.]
+ * @param f   [file]
+ * @param dir [O_RDONLY or O_WRONLY]
+ * @param buf [bytes]
+ * @param n   [return value of the system call]
+ */
+void io61_crcadd(io61_file* f, int dir, const char* buf, ssize_t n)
+{
+    if(f -> crc == FALSE || n < 0)
+        return;
+    if(dir == O_WRONLY)
+    {
+        f -> crcout = io61_crc32c(f -> crcout, buf, n);
+        f -> crcoutlen += n;
+    }else if(n == 0)
+        f -> crceof = TRUE;
+    else
+    {
+        f -> crcin = io61_crc32c(f -> crcin, buf, n);
+        f -> crcinlen += n;
+    }
+}
+
+/**
+ * [io61_crcaddv io61_crcadd for the first `n` bytes described by `iov`]
+ * @param f      [file]
+ * @param dir    [O_RDONLY or O_WRONLY]
+ * @param iov    [fragments]
+ * @param iovcnt [number of fragments]
+ * @param n      [return value of the system call]
+ */
+void io61_crcaddv(io61_file* f, int dir, const struct iovec* iov, int iovcnt, ssize_t n)
+{
+    if(f -> crc == FALSE || n < 0)
+        return;
+    if(n == 0)
+        io61_crcadd(f, dir, NULL, 0);
+    for(int k = 0; k < iovcnt && n > 0; k++)
+    {
+        size_t len = iov[k].iov_len < (size_t) n ? iov[k].iov_len : (size_t) n;
+        io61_crcadd(f, dir, (const char*) iov[k].iov_base, len);
+        n -= len;
+    }
+}
+
+/**
+ * [io61_crcclose settles the sidecar of `f` at io61_close: a writer records its checksum and
+ *                length, a reader that reached the end of the file compares them]
+ * @param  f [file in integrity mode, flushed]
+ * @return   [0 on success or when there is nothing to check; -1 with errno EIO on a mismatch]
+ */
+int io61_crcclose(io61_file* f)
+{
+    char line[64];
+    int r = SUCCESS;
+
+    if(f -> mode == O_WRONLY)
+    {
+        int fd = open(f -> crcpath, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        int n = snprintf(line, sizeof(line), "%08x %llu\n", f -> crcout, f -> crcoutlen);
+        if(fd < 0 || write(fd, line, n) != n)
+            r = FAIL;
+        if(fd >= 0)
+            close(fd);
+    }else if(f -> crceof)
+    {
+        // a missing sidecar leaves nothing to check
+        int fd = open(f -> crcpath, O_RDONLY);
+        if(fd < 0)
+            return SUCCESS;
+        ssize_t n = read(fd, line, sizeof(line) - 1);
+        close(fd);
+        unsigned crc;
+        unsigned long long len;
+        line[n > 0 ? n : 0] = 0;
+        if(sscanf(line, "%x %llu", &crc, &len) == 2 && (crc != f -> crcin || len != f -> crcinlen))
+        {
+            fprintf(stderr, "io61: %s: checksum mismatch (%08x over %llu bytes, expected %08x over %llu)\n",
+                    f -> crcpath, f -> crcin, f -> crcinlen, crc, len);
+            f -> stats.errors++;
+            errno = EIO;
+            r = FAIL;
+        }
+    }
+
+    return r;
+}
+
+/**
+ * [io61_crcinit builds the slice-by-8 tables and finds out whether the CPU has the SSE4.2
+ *               crc32 instruction (run once, through `crconce`)]
+ */
+void io61_crcinit(void)
+{
+    for(int i = 0; i < 256; i++)
+    {
+        uint32_t c = i;
+        for(int k = 0; k < 8; k++)
+            c = c & 1 ? (c >> 1) ^ CRCPOLY : c >> 1;
+        crctable[0][i] = c;
+    }
+    for(int i = 0; i < 256; i++)
+        for(int t = 1; t < 8; t++)
+            crctable[t][i] = (crctable[t - 1][i] >> 8) ^ crctable[0][ crctable[t - 1][i] & 0xff ];
+
+#ifdef HAVE_CRC32C_HW
+    crchw = __builtin_cpu_supports("sse4.2") ? TRUE : FALSE;
+#endif
+}
+
+#ifdef HAVE_CRC32C_HW
+/**
+ * [io61_crc32c_hw updates the raw (inverted) CRC32C `c` with the crc32 instruction, 8 bytes
+ *                 at a time on 64-bit builds]
+ * @param  c [raw checksum]
+ * @param  p [bytes]
+ * @param  n [number of bytes]
+ * @return   [raw checksum]
+ */
+__attribute__((target("sse4.2")))
+uint32_t io61_crc32c_hw(uint32_t c, const unsigned char* p, size_t n)
+{
+#ifdef __x86_64__
+    uint64_t c64 = c;
+    for(; n >= 8; n -= 8, p += 8)
+    {
+        uint64_t v;
+        memcpy(&v, p, 8);
+        c64 = _mm_crc32_u64(c64, v);
+    }
+    c = (uint32_t) c64;
+#endif
+    for(; n >= 4; n -= 4, p += 4)
+    {
+        uint32_t v;
+        memcpy(&v, p, 4);
+        c = _mm_crc32_u32(c, v);
+    }
+    for(; n > 0; n--)
+        c = _mm_crc32_u8(c, *p++);
+    return c;
+}
+#endif
+
+/**
+ * [io61_crc32c continues the CRC32C (Castagnoli) `crc` over `n` more bytes, with the crc32
+ *              instruction when the CPU has it and slice-by-8 tables otherwise]
+ * @param  crc [checksum of the bytes before, 0 for none]
+ * @param  buf [bytes]
+ * @param  n   [number of bytes]
+ * @return     [checksum of all the bytes]
+ */
+uint32_t io61_crc32c(uint32_t crc, const char* buf, size_t n)
+{
+    const unsigned char* p = (const unsigned char*) buf;
+    uint32_t c = ~crc;
+
+#ifdef HAVE_CRC32C_HW
+    if(crchw)
+        return ~io61_crc32c_hw(c, p, n);
+#endif
+    for(; n >= 8; n -= 8, p += 8)
+    {
+        uint32_t lo = c ^ (p[0] | p[1] << 8 | p[2] << 16 | (uint32_t) p[3] << 24);
+        uint32_t hi = p[4] | p[5] << 8 | p[6] << 16 | (uint32_t) p[7] << 24;
+        c = crctable[7][lo & 0xff] ^ crctable[6][(lo >> 8) & 0xff]
+            ^ crctable[5][(lo >> 16) & 0xff] ^ crctable[4][lo >> 24]
+            ^ crctable[3][hi & 0xff] ^ crctable[2][(hi >> 8) & 0xff]
+            ^ crctable[1][(hi >> 16) & 0xff] ^ crctable[0][hi >> 24];
+    }
+    for(; n > 0; n--)
+        c = (c >> 8) ^ crctable[0][(c ^ *p++) & 0xff];
+    return ~c;
+}
+
+/**
+ * [io61_msgmode puts the pipe or socket `f` in message mode. Buffered output is flushed as soon
+ *               as `threshold` bytes are waiting, or by the first write that finds the oldest
+ *               waiting byte more than `delay_us` microseconds old, like Nagle's algorithm.
+ *               Whenever a message mode reader is about to block, the output of every file in
+ *               message mode is flushed first, so a request never waits for its own reply.]
+ * @param  f         [file]
+ * @param  threshold [bytes; 0 flushes every write, a buffer or more only full buffers]
+ * @param  delay_us  [largest age of buffered output, in microseconds; -1 for no deadline]
+ * @return           [0 on success, -1 if `f` is seekable or uses another backend]
+ */
+int io61_msgmode(io61_file* f, size_t threshold, long delay_us)
+{
+    if(f -> async || f -> uring || f -> zip || f -> seq == FALSE || lseek(f -> fd, 0, SEEK_CUR) != (off_t) -1)
+        return FAIL;
+
+    f -> msgthreshold = threshold < f -> bufcap ? threshold : f -> bufcap;
+    f -> tuning = FALSE;
+    f -> msgdelay = delay_us;
+    if(f -> msg == FALSE)
+    {
+        f -> msg = TRUE;
+        f -> msgstamped = FALSE;
+        f -> msgowner = pthread_self();
+        pthread_mutex_lock(&msglock);
+        f -> msgnext = msgfiles;
+        msgfiles = f;
+        pthread_mutex_unlock(&msglock);
+    }
+
+    return io61_msgcheck(f);
+}
+
+/**
+ * [io61_msgcheck applies the flush policy of the message mode file `f` after a write]
+ * @param  f [file]
+ * @return   [0 on success, -1 if a flush failed]
+ */
+int io61_msgcheck(io61_file* f)
+{
+    int i = f -> slot;
+    if(i < 0 || f -> dir != O_WRONLY || cache[i].offset == 0)
+        return SUCCESS;
+    if(cache[i].offset >= f -> msgthreshold)
+        return io61_flush(f);
+    if(f -> msgdelay < 0)
+        return SUCCESS;
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    if(f -> msgstamped == FALSE)
+    {
+        f -> msgsince = now;
+        f -> msgstamped = TRUE;
+        return SUCCESS;
+    }
+
+    long age = (now.tv_sec - f -> msgsince.tv_sec) * 1000000L
+             + (now.tv_nsec - f -> msgsince.tv_nsec) / 1000;
+    if(age >= f -> msgdelay)
+        return io61_flush(f);
+    return SUCCESS;
+}
+
+/**
+ * [io61_msgwait is called before the message mode reader `f` refills its buffer. If no input is
+ *               ready, the read would block, so every file the calling thread put in message
+ *               mode sends its output now; other threads' files are theirs to flush.]
+ * @param  f [file]
+ */
+void io61_msgwait(io61_file* f)
+{
+    if(io61_ready(f, POLLIN))
+        return;
+
+    pthread_t self = pthread_self();
+    pthread_mutex_lock(&msglock);
+    for(io61_file* g = msgfiles; g; g = g -> msgnext)
+        if(pthread_equal(g -> msgowner, self) && g -> mode != O_RDONLY && g -> dir == O_WRONLY)
+            io61_flush(g);
+    pthread_mutex_unlock(&msglock);
+}
+
+/**
+ * [io61_memchr finds the first byte `c` in the `n` bytes at `s`, comparing 32 (AVX2) or
+ *              16 (SSE2) bytes per instruction]
+ * @param  s [bytes to scan]
+ * @param  c [byte to find]
+ * @param  n [number of bytes]
+ * @return   [pointer to the byte, NULL if there is none]
+ */
+const char* io61_memchr(const char* s, int c, size_t n)
+{
+    size_t k = 0;
+#ifdef __AVX2__
+    __m256i needle32 = _mm256_set1_epi8((char) c);
+    for(; k + 32 <= n; k += 32)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i*) (s + k));
+        unsigned m = _mm256_movemask_epi8(_mm256_cmpeq_epi8(v, needle32));
+        if(m)
+            return s + k + __builtin_ctz(m);
+    }
+#endif
+#ifdef __SSE2__
+    __m128i needle16 = _mm_set1_epi8((char) c);
+    for(; k + 16 <= n; k += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i*) (s + k));
+        unsigned m = _mm_movemask_epi8(_mm_cmpeq_epi8(v, needle16));
+        if(m)
+            return s + k + __builtin_ctz(m);
+    }
+    for(; k < n; k++)
+        if(s[k] == (char) c)
+            return s + k;
+    return NULL;
+#else
+    return (const char*) memchr(s + k, c, n - k);
+#endif
+}
+
+/**
+ * [io61_lineappend copies `n` bytes to offset `held` of the record buffer of `f`, growing it]
+ * @param  f    [file]
+ * @param  held [bytes already in the record buffer]
+ * @param  s    [bytes to append]
+ * @param  n    [number of bytes]
+ * @return      [0 on success, -1 if out of memory]
+ */
+int io61_lineappend(io61_file* f, size_t held, const char* s, size_t n)
+{
+    if(held + n > f -> linecap)
+    {
+        size_t cap = f -> linecap ? f -> linecap : BUFSIZE;
+        while(cap < held + n)
+            cap *= 2;
+        char* b = (char*) realloc(f -> linebuf, cap);
+        if(b == NULL)
+            return FAIL;
+        f -> linebuf = b;
+        f -> linecap = cap;
+    }
+    memcpy(f -> linebuf + held, s, n);
+    return SUCCESS;
+}
+
+/**
+ * [io61_read_until reads from `f` up to and including the next byte `delim`. A record that lies
+ *                  inside the stream buffer is not copied: `*data` points into the buffer.
+ *                  Records that span refills are assembled in a buffer owned by `f`.
+ *                  Either way `*data` stays valid until the next call on `f`.]
+ * @param  f     [file]
+ * @param  delim [delimiter byte]
+ * @param  data  [receives the first byte of the record]
+ * @return       [length of the record including `delim`; the last record may lack it;
+ *                0 at end of file; -1 on error]
+ */
+ssize_t io61_read_until(io61_file* f, int delim, const char** data)
+{
+    size_t held = 0;
+
+    if(f -> async || f -> uring || f -> zip || f -> seq == FALSE)
+    {
+        // these modes have no stream buffer to scan
+        int c;
+        while((c = io61_readc(f)) != EOF)
+        {
+            char ch = c;
+            if(io61_lineappend(f, held++, &ch, 1) == FAIL)
+                return FAIL;
+            if(ch == (char) delim)
+                break;
+        }
+        *data = f -> linebuf;
+        return held;
+    }
+    if(f -> mode == O_RDWR && io61_turn(f, O_RDONLY) == FAIL)
+        return FAIL;
+
+    int i = io61_findslot(f);
+    if(i < 0)
+    {
+        i = io61_getslot(f);
+        if(i < 0)
+            return FAIL;
+        cache[i].bufsize = 0;
+    }
+
+    while(1)
+    {
+        if(cache[i].offset == cache[i].bufsize)
+        {
+            if(f -> msg)
+                io61_msgwait(f);
+            ssize_t r = io61_fill(f, i);
+            if(r <= 0)
+            {
+                *data = f -> linebuf;
+                return held ? (ssize_t) held : r;
+            }
+        }
+
+        const char* start = &cache[i].data[ cache[i].offset ];
+        size_t avail = cache[i].bufsize - cache[i].offset;
+        const char* hit = io61_memchr(start, delim, avail);
+        size_t n = hit ? (size_t) (hit - start) + 1 : avail;
+        cache[i].offset += n;
+
+        if(hit && held == 0)
+        {
+            *data = start;
+            return n;
+        }
+        if(io61_lineappend(f, held, start, n) == FAIL)
+            return FAIL;
+        held += n;
+        if(hit)
+        {
+            *data = f -> linebuf;
+            return held;
+        }
+    }
+}
+
+/**
+ * [io61_readline reads the next line of `f`, including its newline, like io61_read_until]
+ * @param  f    [file]
+ * @param  line [receives the first byte of the line]
+ * @return      [length of the line; 0 at end of file; -1 on error]
+ */
+ssize_t io61_readline(io61_file* f, const char** line)
+{
+    return io61_read_until(f, '\n', line);
+}
+
+/**
+ * [io61_recbuf makes the record buffer of `f` hold at least `size` bytes, rounded up to
+ *              RECALIGN so vector code may read a whole last lane. Its contents are kept.]
+ * @param  f    [file]
+ * @param  size [bytes needed]
+ * @return      [0 on success, -1 if out of memory]
+ */
+int io61_recbuf(io61_file* f, size_t size)
+{
+    size = (size + RECALIGN - 1) & ~((size_t) RECALIGN - 1);
+    if(size <= f -> reccap)
+        return SUCCESS;
+
+    void* p = NULL;
+    if(posix_memalign(&p, RECALIGN, size) != 0)
+    {
+        errno = ENOMEM;
+        return FAIL;
+    }
+    if(f -> recbuf)
+        memcpy(p, f -> recbuf, f -> reccap);
+    free(f -> recbuf);
+    f -> recbuf = (char*) p;
+    f -> reccap = size;
+    return SUCCESS;
+}
+
+/**
+ * [io61_read_records reads a batch of up to `max` records of `recsize` bytes from `f` and lends
+ *                    it to the caller as an array: `*view` is aligned to RECALIGN bytes, and
+ *                    is readable up to the next multiple of RECALIGN past the last record. The
+ *                    batch usually lies in the stream buffer and is not copied: a record that
+ *                    straddles a refill is moved to the front of the buffer and completed
+ *                    there, so each refill starts aligned. Batches that do not (a `max` whose
+ *                    records do not fill a multiple of RECALIGN bytes), and files without a
+ *                    stream buffer, are copied to a buffer owned by `f`. Either way the view
+ *                    stays valid until the next call on `f`.]
+ * @param  f       [file]
+ * @param  recsize [bytes per record]
+ * @param  max     [most records to return]
+ * @param  view    [receives the first record]
+ * @return         [number of records, at least 1; 0 at end of file; -1 on error, or with errno
+ *                  EIO if the file ends inside a record. The bytes of that record stay unread
+ *                  for io61_read.]
+ */
+ssize_t io61_read_records(io61_file* f, size_t recsize, size_t max, const void** view)
+{
+    if(recsize == 0)
+    {
+        errno = EINVAL;
+        return FAIL;
+    }
+    if(max == 0)
+        return 0;
+    if(f -> async || f -> uring || f -> zip || f -> direct || f -> seq == FALSE || recsize > MAXBUFSIZE
+       || f -> rectail)
+        return io61_read_reccopy(f, recsize, max, view);
+    if(f -> mode == O_RDWR && io61_turn(f, O_RDONLY) == FAIL)
+        return FAIL;
+
+    int i = io61_findslot(f);
+    if(i < 0)
+    {
+        i = io61_getslot(f);
+        if(i < 0)
+            return FAIL;
+        cache[i].bufsize = 0;
+    }
+
+    size_t avail = cache[i].bufsize - cache[i].offset;
+    if(avail < recsize)
+    {
+        if(f -> bufcap < recsize)
+            f -> bufcap = io61_bufround(recsize);
+        io61_streambuf(f, i);
+        if(cache[i].cap < recsize)
+            return io61_read_reccopy(f, recsize, max, view);    // over the memory budget
+        if(f -> msg)
+            io61_msgwait(f);
+
+        ssize_t r = 1;
+        while(avail < recsize && r > 0)
+        {
+            r = io61_refill(f, i, avail);
+            avail = cache[i].bufsize - cache[i].offset;
+        }
+        if(r < 0 && avail < recsize)
+            return FAIL;
+        if(avail == 0)
+            return 0;
+        if(avail < recsize)
+        {
+            errno = EIO;
+            return FAIL;
+        }
+    }
+
+    size_t n = avail / recsize;
+    if(n > max)
+        n = max;
+    const char* start = &cache[i].data[ cache[i].offset ];
+    if(((unsigned long) start & (RECALIGN - 1)) != 0)
+    {
+        if(io61_recbuf(f, n * recsize) == FAIL)
+            return FAIL;
+        memcpy(f -> recbuf, start, n * recsize);
+        start = f -> recbuf;
+    }
+    cache[i].offset += n * recsize;
+    *view = start;
+    return n;
+}
+
+/**
+ * [io61_read_reccopy io61_read_records through io61_read, for files without a stream buffer
+ *                    to lend and for records larger than one. A batch holds up to RECBATCH
+ *                    bytes, or one record. A partial last record is left unread: a random
+ *                    access file steps back over it, other files hold it in `recbuf` behind
+ *                    the batch, for the next batch or io61_read.]
+ * @param  f       [file]
+ * @param  recsize [bytes per record]
+ * @param  max     [most records to return]
+ * @param  view    [receives the first record]
+ * @return         [as io61_read_records]
+ */
+ssize_t io61_read_reccopy(io61_file* f, size_t recsize, size_t max, const void** view)
+{
+    size_t n = RECBATCH / recsize;
+    if(n == 0)
+        n = 1;
+    if(n > max)
+        n = max;
+    if(io61_recbuf(f, n * recsize) == FAIL)
+        return FAIL;
+
+    // a held partial record starts the batch
+    size_t held = f -> rectail;
+    memmove(f -> recbuf, f -> recbuf + f -> recoff, held);
+    f -> rectail = 0;
+    ssize_t r = io61_read(f, f -> recbuf + held, n * recsize - held);
+    if(r < 0 && held == 0)
+        return FAIL;
+    size_t total = held + (r > 0 ? r : 0);
+    if(total == 0)
+        return 0;
+
+    size_t tail = total % recsize;
+    if(tail && f -> seq == FALSE)
+        f -> pos -= tail;
+    else if(tail)
+    {
+        f -> rectail = tail;
+        f -> recoff = total - tail;
+    }
+    if(r < 0)
+        return FAIL;
+    if(total < recsize)
+    {
+        errno = EIO;
+        return FAIL;
+    }
+
+    *view = f -> recbuf;
+    return total / recsize;
+}
+
+/**
+ * [io61_syncmode takes `f` out of async and io_uring modes, as io61_seek does, so its
+ *                stream buffer can be lent out. Pending output is written first.]
+ * @param  f [file]
+ * @return   [0 on success, -1 if pending output could not be written]
+ */
+int io61_syncmode(io61_file* f)
+{
+    int r = SUCCESS;
+    if(f -> async)
+    {
+        if(io61_async_flush(f) == FAIL)
+            r = FAIL;
+        if(io61_async_stop(f) == FAIL)
+            r = FAIL;
+    }
+#ifdef HAVE_URING
+    // the descriptor is left at the read or write position
+    if(f -> uring)
+    {
+        if(io61_flush(f) == FAIL)
+            r = FAIL;
+        if(io61_uring_stop(f) == FAIL)
+            r = FAIL;
+    }
+#endif
+    return r;
+}
+
+/**
+ * [io61_peek lends the caller the bytes at the read position of `f`, without copying them:
+ *            the rest of the stream buffer, or of the cached block for a random access file.
+ *            Nothing is consumed; the bytes stay valid until the next call on `f`.
+ *            An async reader lends the rest of its current ring buffer; an io_uring file
+ *            leaves io_uring mode first.]
+ * @param  f   [file]
+ * @param  ptr [receives the first byte]
+ * @param  len [receives the number of bytes available; 0 at end of file]
+ * @return     [0 on success; -1 on error, or for a compressed stream]
+ */
+int io61_peek(io61_file* f, const char** ptr, size_t* len)
+{
+    if(f -> zip)
+    {
+        errno = EINVAL;
+        return FAIL;
+    }
+
+    // stopping the helper thread would drop its read-ahead
+    if(f -> async && f -> mode == O_RDONLY)
+    {
+        asyncbuf* b = io61_async_rdbuf(f -> async);
+        if(b -> len < 0)
+            return FAIL;
+        *ptr = b -> data + b -> offset;
+        *len = b -> len - b -> offset;
+        return SUCCESS;
+    }
+    if((f -> async || f -> uring) && io61_syncmode(f) == FAIL)
+        return FAIL;
+
+    if(f -> seq == FALSE)
+    {
+        // the block is pinned, so other threads cannot evict it while the caller reads it
+        off_t block = f -> pos - f -> pos % BUFSIZE;
+        pthread_mutex_lock(&f -> shard -> lock);
+        int i = io61_lookup(f, block);
+        if(i < 0)
+            i = io61_loadblock(f, block, TRUE);
+        if(i >= 0)
+            io61_pin(f, i);
+        pthread_mutex_unlock(&f -> shard -> lock);
+        if(i < 0)
+            return FAIL;
+        size_t off = f -> pos - block;
+        *ptr = &cache[i].data[off];
+        *len = off < cache[i].bufsize ? cache[i].bufsize - off : 0;
+        return SUCCESS;
+    }
+
+    if(f -> mode == O_RDWR && io61_turn(f, O_RDONLY) == FAIL)
+        return FAIL;
+    int i = io61_findslot(f);
+    if(i < 0)
+    {
+        i = io61_getslot(f);
+        if(i < 0)
+            return FAIL;
+        cache[i].bufsize = 0;
+    }
+    if(cache[i].offset == cache[i].bufsize)
+    {
+        if(f -> msg)
+            io61_msgwait(f);
+        if(io61_fill(f, i) < 0)
+            return FAIL;
+    }
+
+    *ptr = &cache[i].data[ cache[i].offset ];
+    *len = cache[i].bufsize - cache[i].offset;
+    return SUCCESS;
+}
+
+/**
+ * [io61_consume advances the read position of `f` past `n` bytes returned by io61_peek]
+ * @param  f [file]
+ * @param  n [number of bytes, at most the length io61_peek reported]
+ * @return   [0 on success, -1 if fewer than `n` bytes are buffered]
+ */
+int io61_consume(io61_file* f, size_t n)
 {
-    cacheslot temp;
-    int i = first, 
-    j = last, 
-    x = cache[(first + last) / 2].pos;
- 
-    do {
-        while (cache[i].pos < x) i++;
-        while (cache[j].pos > x) j--;
- 
-        if(i <= j) {
-            if (i < j)
+    if(f -> async && f -> mode == O_RDONLY)
+    {
+        asyncbuf* b = &f -> async -> bufs[f -> async -> cons];
+        if(!f -> async -> held || b -> len < 0 || n > (size_t) b -> len - b -> offset)
+        {
+            errno = EINVAL;
+            return FAIL;
+        }
+        b -> offset += n;
+        return SUCCESS;
+    }
+
+    if(f -> seq == FALSE)
+    {
+        f -> pos += n;
+        return SUCCESS;
+    }
+
+    int i = io61_findslot(f);
+    if(f -> async || f -> uring || f -> zip || i < 0 || f -> dir != O_RDONLY
+       || n > cache[i].bufsize - cache[i].offset)
+    {
+        errno = EINVAL;
+        return FAIL;
+    }
+    cache[i].offset += n;
+    return SUCCESS;
+}
+
+/**
+ * [io61_reserve lends the caller free space in the write buffer of `f`, at the write position,
+ *               so output can be produced in place. A full buffer is flushed first.
+ *               The space stays valid until the next call on `f`.]
+ * @param  f   [file]
+ * @param  ptr [receives the first free byte]
+ * @param  len [receives the number of free bytes, at least 1]
+ * @return     [0 on success; -1 on error, for a compressed stream, or when unread input
+ *              holds the buffer of an O_RDWR stream. Async and io_uring files leave those
+ *              modes first.]
+ */
+int io61_reserve(io61_file* f, char** ptr, size_t* len)
+{
+    if(f -> zip)
+    {
+        errno = EINVAL;
+        return FAIL;
+    }
+    if((f -> async || f -> uring) && io61_syncmode(f) == FAIL)
+        return FAIL;
+
+    if(f -> seq == FALSE)
+    {
+        off_t block = f -> pos - f -> pos % BUFSIZE;
+        pthread_mutex_lock(&f -> shard -> lock);
+        int i = io61_lookup(f, block);
+        if(i < 0)
+            i = io61_loadblock(f, block, f -> mode == O_RDWR);
+
+        // the bytes to come must touch the dirty range, as in io61_write_cached
+        size_t off = f -> pos - block;
+        if(i >= 0 && cache[i].dirtylo < cache[i].dirtyhi
+           && (off > cache[i].dirtyhi || off < cache[i].dirtylo)
+           && io61_writeback(i) == FAIL)
+            i = FAIL;
+        if(i >= 0)
+            io61_pin(f, i);
+        pthread_mutex_unlock(&f -> shard -> lock);
+        if(i < 0)
+            return FAIL;
+        *ptr = &cache[i].data[off];
+        *len = BUFSIZE - off;
+        return SUCCESS;
+    }
+
+    if(f -> mode == O_RDWR && io61_turn(f, O_WRONLY) == FAIL)
+    {
+        errno = EBUSY;
+        return FAIL;
+    }
+    int i = io61_findslot(f);
+    if(i < 0)
+        i = io61_getslot(f);
+    if(i < 0)
+        return FAIL;
+    if(cache[i].offset == cache[i].bufsize)
+    {
+        f -> stats.misses++;
+        if(io61_flush(f) == FAIL)
+            return FAIL;
+    }
+
+    *ptr = &cache[i].data[ cache[i].offset ];
+    *len = cache[i].bufsize - cache[i].offset;
+    return SUCCESS;
+}
+
+/**
+ * [io61_commit makes the first `n` bytes of the space returned by io61_reserve part of the
+ *              output of `f`]
+ * @param  f [file]
+ * @param  n [number of bytes, at most the length io61_reserve reported]
+ * @return   [0 on success, -1 on error]
+ */
+int io61_commit(io61_file* f, size_t n)
+{
+    if(f -> seq == FALSE)
+    {
+        off_t block = f -> pos - f -> pos % BUFSIZE;
+        pthread_mutex_lock(&f -> shard -> lock);
+        int i = io61_lookup(f, block);
+        size_t off = f -> pos - block;
+        if(i >= 0 && n <= BUFSIZE - off && n > 0)
+            io61_markdirty(i, off, n);
+        pthread_mutex_unlock(&f -> shard -> lock);
+        if(i < 0 || n > BUFSIZE - off)
+        {
+            errno = EINVAL;
+            return FAIL;
+        }
+        f -> pos += n;
+        return SUCCESS;
+    }
+
+    int i = io61_findslot(f);
+    if(f -> async || f -> uring || f -> zip || i < 0 || f -> dir != O_WRONLY
+       || n > cache[i].bufsize - cache[i].offset)
+    {
+        errno = EINVAL;
+        return FAIL;
+    }
+    cache[i].offset += n;
+    if(f -> msg)
+        return io61_msgcheck(f);
+    return SUCCESS;
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// Non-blocking API. The io61_try_ calls never wait for a pipe or socket; a pollset multiplexes
+// many files in one thread with epoll(7), taking buffered data into account.
+
+/**
+ * [io61_ready tells whether `f` can be read (POLLIN) or written (POLLOUT) without blocking]
+ * @param  f      [file]
+ * @param  events [POLLIN or POLLOUT]
+ * @return        [TRUE or FALSE]
+ */
+int io61_ready(io61_file* f, short events)
+{
+    struct pollfd p;
+    p.fd = f -> fd;
+    p.events = events;
+    long long start = io61_clock();
+    int r = poll(&p, 1, 0);
+    io61_count(f, SYS_POLL, start, r);
+    return r > 0;
+}
+
+/**
+ * [io61_fileno returns the file descriptor whose readiness reflects `f`, for callers that run
+ *              their own event loop. Buffered input is invisible to it: drain `f` with
+ *              io61_try_read until EAGAIN before waiting on the descriptor.]
+ * @param  f [file]
+ * @return   [file descriptor]
+ */
+int io61_fileno(io61_file* f)
+{
+    return f -> fd;
+}
+
+/**
+ * [io61_try_read reads up to `sz` characters from `f` without waiting: it returns whatever is
+ *                buffered or can be read right away, which may be less than `sz`.]
+ * @param  f   [file]
+ * @param  buf [destination]
+ * @param  sz  [maximum number of bytes]
+ * @return     [number of bytes read; 0 at end of file; -1 with errno EAGAIN if no input is ready,
+ *              or -1 on error]
+ */
+ssize_t io61_try_read(io61_file* f, char* buf, size_t sz)
+{
+    // regular files and the other backends never wait for input
+    if(f -> async || f -> uring || f -> zip || f -> seq == FALSE || f -> direct)
+        return io61_read(f, buf, sz);
+
+    int i = io61_findslot(f);
+    if(f -> mode == O_RDWR && f -> dir == O_WRONLY && i >= 0 && cache[i].offset > 0)
+    {
+        // the buffer holds output that may not go out yet: read straight into `buf`
+        if(!io61_ready(f, POLLIN))
+        {
+            errno = EAGAIN;
+            return FAIL;
+        }
+        ssize_t r;
+        do
+        {
+            long long start = io61_clock();
+            r = read(f -> fd, buf, sz);
+            io61_count(f, SYS_READ, start, r);
+        }while(r == -1 && errno == EINTR);
+        io61_crcadd(f, O_RDONLY, buf, r);
+        return r;
+    }
+    if(f -> mode == O_RDWR && io61_turn(f, O_RDONLY) == FAIL)
+        return FAIL;
+
+    if(i < 0)
+    {
+        i = io61_getslot(f);
+        if(i < 0)
+            return FAIL;
+        cache[i].bufsize = 0;
+    }
+
+    if(sz > 0 && cache[i].offset == cache[i].bufsize)
+    {
+        if(!io61_ready(f, POLLIN))
+        {
+            if(f -> msg)
+                io61_msgwait(f);
+            errno = EAGAIN;
+            return FAIL;
+        }
+        ssize_t r = io61_fill(f, i);
+        if(r <= 0)
+            return r;
+    }
+
+    size_t n = cache[i].bufsize - cache[i].offset;
+    if(n > sz)
+        n = sz;
+    memcpy(buf, &cache[i].data[ cache[i].offset ], n);
+    cache[i].offset += n;
+    return n;
+}
+
+/**
+ * [io61_try_flush writes as much buffered output of `f` as the descriptor takes without waiting.
+ *                 Every write is at most PIPE_BUF bytes, which a pipe or socket reported
+ *                 writable accepts at once.]
+ * @param  f [file]
+ * @return   [0 if nothing is left buffered; -1 with errno EAGAIN if output remains, or -1 on error]
+ */
+int io61_try_flush(io61_file* f)
+{
+    if(f -> async || f -> uring || f -> zip || f -> seq == FALSE || f -> direct)
+        return io61_flush(f);
+
+    int i = f -> slot;
+    if(i < 0 || f -> dir != O_WRONLY || cache[i].offset == 0)
+        return SUCCESS;
+
+    size_t done = 0;
+    int r = SUCCESS;
+    while(done < cache[i].offset && io61_ready(f, POLLOUT))
+    {
+        size_t len = cache[i].offset - done;
+        if(len > PIPE_BUF)
+            len = PIPE_BUF;
+        long long start = io61_clock();
+        ssize_t n = write(f -> fd, &cache[i].data[done], len);
+        io61_count(f, SYS_WRITE, start, n);
+        io61_crcadd(f, O_WRONLY, &cache[i].data[done], n);
+        if(n == -1 && errno == EINTR)
+            continue;
+        if(n <= 0)
+        {
+            r = FAIL;
+            break;
+        }
+        done += n;
+    }
+
+    f -> stats.hitbytes += done;
+    memmove(cache[i].data, &cache[i].data[done], cache[i].offset - done);
+    cache[i].offset -= done;
+    if(cache[i].offset == 0)
+    {
+        f -> msgstamped = FALSE;
+        return SUCCESS;
+    }
+    if(r == SUCCESS)
+        errno = EAGAIN;
+    return FAIL;
+}
+
+/**
+ * [io61_try_write buffers up to `sz` characters for `f` without waiting. When the buffer is
+ *                 full, buffered output is first pushed out as far as the descriptor allows.]
+ * @param  f   [file]
+ * @param  buf [bytes to write]
+ * @param  sz  [number of bytes]
+ * @return     [number of bytes taken, possibly less than `sz`; -1 with errno EAGAIN if none
+ *              fit, or -1 on error]
+ */
+ssize_t io61_try_write(io61_file* f, const char* buf, size_t sz)
+{
+    if(f -> async || f -> uring || f -> zip || f -> seq == FALSE || f -> direct)
+        return io61_write(f, buf, sz);
+
+    if(f -> mode == O_RDWR && io61_turn(f, O_WRONLY) == FAIL)
+    {
+        // unread input holds the buffer: write straight from `buf`
+        if(!io61_ready(f, POLLOUT))
+        {
+            errno = EAGAIN;
+            return FAIL;
+        }
+        ssize_t n;
+        do
+        {
+            long long start = io61_clock();
+            n = write(f -> fd, buf, sz < PIPE_BUF ? sz : PIPE_BUF);
+            io61_count(f, SYS_WRITE, start, n);
+        }while(n == -1 && errno == EINTR);
+        io61_crcadd(f, O_WRONLY, buf, n);
+        return n;
+    }
+
+    int i = io61_findslot(f);
+    if(i < 0)
+        i = io61_getslot(f);
+    if(i < 0)
+        return FAIL;
+    if(sz > 0 && cache[i].offset == cache[i].bufsize && io61_try_flush(f) == FAIL
+       && cache[i].offset == cache[i].bufsize)
+        return FAIL;
+
+    size_t n = cache[i].bufsize - cache[i].offset;
+    if(n > sz)
+        n = sz;
+    memcpy(&cache[i].data[ cache[i].offset ], buf, n);
+    cache[i].offset += n;
+
+    if(f -> msg && cache[i].offset >= f -> msgthreshold)
+        io61_try_flush(f);
+    return n;
+}
+
+/**
+ * [io61_pollset_new creates an empty set of files to wait on with io61_poll]
+ * @return [the set, or NULL on error]
+ */
+io61_pollset* io61_pollset_new(void)
+{
+    io61_pollset* ps = (io61_pollset*) malloc(sizeof(io61_pollset));
+    if(ps == NULL)
+    {
+        errno = ENOMEM;
+        return NULL;
+    }
+#ifdef __linux__
+    ps -> epfd = epoll_create1(EPOLL_CLOEXEC);
+    if(ps -> epfd == -1)
+    {
+        free(ps);
+        return NULL;
+    }
+#endif
+    ps -> members = NULL;
+    ps -> n = ps -> cap = 0;
+    return ps;
+}
+
+/**
+ * [io61_pollset_free releases `ps`; its files stay open]
+ * @param ps [set]
+ */
+void io61_pollset_free(io61_pollset* ps)
+{
+#ifdef __linux__
+    close(ps -> epfd);
+#endif
+    free(ps -> members);
+    free(ps);
+}
+
+/**
+ * [io61_pollset_interest computes the kernel events member `k` of `ps` must be watched for:
+ *                        input if the caller asked for it, output while `f` has some buffered]
+ * @param  ps [set]
+ * @param  k  [index of the member]
+ * @return    [poll(2) event bits, which Linux gives the same values as the epoll ones]
+ */
+int io61_pollset_interest(io61_pollset* ps, int k)
+{
+    io61_file* f = ps -> members[k].f;
+    int i = f -> slot;
+    int want = ps -> members[k].events & POLLIN;
+    if(i >= 0 && f -> dir == O_WRONLY && f -> seq && cache[i].offset > 0)
+        want |= POLLOUT;
+    return want;
+}
+
+/**
+ * [io61_pollset_add adds `f` to `ps`. A file must be removed before it is closed.]
+ * @param  ps     [set]
+ * @param  f      [file]
+ * @param  events [POLLIN and/or POLLOUT; 0 only keeps the buffered output of `f` moving]
+ * @return        [0 on success, -1 on error]
+ */
+int io61_pollset_add(io61_pollset* ps, io61_file* f, int events)
+{
+    if(ps -> n == ps -> cap)
+    {
+        int cap = ps -> cap ? 2 * ps -> cap : 64;
+        pollmember* m = (pollmember*) realloc(ps -> members, cap * sizeof(pollmember));
+        if(m == NULL)
+            return FAIL;
+        ps -> members = m;
+        ps -> cap = cap;
+    }
+
+    int k = ps -> n;
+    ps -> members[k].f = f;
+    ps -> members[k].events = events;
+    ps -> members[k].registered = io61_pollset_interest(ps, k);
+#ifdef __linux__
+    struct epoll_event ev;
+    ev.events = ps -> members[k].registered;
+    ev.data.u64 = k;
+    if(epoll_ctl(ps -> epfd, EPOLL_CTL_ADD, f -> fd, &ev) == -1)
+    {
+        // regular files cannot be watched: they are always ready
+        if(errno != EPERM)
+            return FAIL;
+        ps -> members[k].registered = -1;
+    }
+#endif
+    ps -> n++;
+    return SUCCESS;
+}
+
+/**
+ * [io61_pollset_del removes `f` from `ps`]
+ * @param  ps [set]
+ * @param  f  [file]
+ * @return    [0 on success, -1 if `f` is not in the set]
+ */
+int io61_pollset_del(io61_pollset* ps, io61_file* f)
+{
+    int k = 0;
+    while(k < ps -> n && ps -> members[k].f != f)
+        k++;
+    if(k == ps -> n)
+        return FAIL;
+
+#ifdef __linux__
+    if(ps -> members[k].registered >= 0)
+        epoll_ctl(ps -> epfd, EPOLL_CTL_DEL, f -> fd, NULL);
+#endif
+
+    // the last member moves into the hole, and the kernel must learn its new index
+    ps -> members[k] = ps -> members[--ps -> n];
+#ifdef __linux__
+    if(k < ps -> n && ps -> members[k].registered >= 0)
+    {
+        struct epoll_event ev;
+        ev.events = ps -> members[k].registered;
+        ev.data.u64 = k;
+        epoll_ctl(ps -> epfd, EPOLL_CTL_MOD, ps -> members[k].f -> fd, &ev);
+    }
+#endif
+    return SUCCESS;
+}
+
+/**
+ * [io61_poll waits until files of `ps` are ready. A file is readable if it holds buffered input
+ *            or its descriptor is readable, and writable while its buffer has room. Buffered
+ *            output is written in the background whenever its descriptor becomes writable.]
+ * @param  ps         [set]
+ * @param  events     [receives the ready files and their POLLIN, POLLOUT, POLLERR, POLLHUP bits]
+ * @param  maxevents  [room in `events`]
+ * @param  timeout_ms [milliseconds to wait at most; -1 waits forever, 0 not at all]
+ * @return            [number of ready files; 0 on timeout; -1 on error]
+ */
+int io61_poll(io61_pollset* ps, io61_event* events, int maxevents, int timeout_ms)
+{
+    struct timespec start, now;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    while(1)
+    {
+        // data io61 already holds is ready whatever the kernel says
+        int n = 0;
+        for(int k = 0; k < ps -> n; k++)
+        {
+            pollmember* m = &ps -> members[k];
+            io61_file* f = m -> f;
+            int i = f -> slot;
+            int r = 0;
+            if((m -> events & POLLIN) && (m -> registered < 0
+               || (i >= 0 && f -> dir == O_RDONLY && cache[i].offset < cache[i].bufsize)))
+                r |= POLLIN;
+            if((m -> events & POLLOUT) && (m -> registered < 0
+               || !(i >= 0 && f -> dir == O_WRONLY && cache[i].offset == cache[i].bufsize)))
+                r |= POLLOUT;
+            if(r && n < maxevents)
             {
-                temp = cache[i];
-                cache[i] = cache[j];
-                cache[j] = temp;
-            } 
-            i++;
-            j--;
+                events[n].f = f;
+                events[n++].events = r;
+            }
+
+            int want = io61_pollset_interest(ps, k);
+            if(m -> registered >= 0 && want != m -> registered)
+            {
+#ifdef __linux__
+                struct epoll_event ev;
+                ev.events = want;
+                ev.data.u64 = k;
+                epoll_ctl(ps -> epfd, EPOLL_CTL_MOD, f -> fd, &ev);
+#endif
+                m -> registered = want;
+            }
         }
-    } while (i <= j);
- 
-    if (i < last)
-        quicksort(i, last);
-    if (first < j)
-        quicksort(first,j);
+        if(n > 0)
+            return n;
+
+        int wait = timeout_ms;
+        if(timeout_ms > 0)
+        {
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            wait -= (now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000;
+            if(wait < 0)
+                wait = 0;
+        }
+
+        int nready;
+#ifdef __linux__
+        struct epoll_event ready[64];
+        long long before = io61_clock();
+        nready = epoll_wait(ps -> epfd, ready, 64, wait);
+        io61_count(NULL, SYS_POLL, before, nready);
+#else
+        struct pollfd* ready = (struct pollfd*) malloc((ps -> n ? ps -> n : 1) * sizeof(struct pollfd));
+        if(ready == NULL)
+        {
+            errno = ENOMEM;
+            return FAIL;
+        }
+        for(int k = 0; k < ps -> n; k++)
+        {
+            ready[k].fd = ps -> members[k].f -> fd;
+            ready[k].events = ps -> members[k].registered;
+        }
+        long long before = io61_clock();
+        nready = poll(ready, ps -> n, wait);
+        io61_count(NULL, SYS_POLL, before, nready);
+#endif
+        if(nready == -1 && errno == EINTR)
+            nready = 0;
+        else if(nready == -1)
+        {
+#ifndef __linux__
+            free(ready);
+#endif
+            return FAIL;
+        }
+
+#ifdef __linux__
+        for(int e = 0; e < nready; e++)
+        {
+            int k = ready[e].data.u64;
+            int got = ready[e].events;
+#else
+        for(int k = 0; nready > 0 && k < ps -> n; k++)
+        {
+            int got = ready[k].revents;
+            if(got == 0)
+                continue;
+#endif
+            pollmember* m = &ps -> members[k];
+            if((got & (POLLOUT | POLLERR | POLLHUP)) && (m -> registered & POLLOUT))
+                io61_try_flush(m -> f);
+
+            int r = got & (POLLERR | POLLHUP);
+            if(m -> events & POLLIN)
+                r |= got & POLLIN;
+            if((m -> events & POLLOUT) && (got & POLLOUT))
+                r |= POLLOUT;
+            if(r && n < maxevents)
+            {
+                events[n].f = m -> f;
+                events[n++].events = r;
+            }
+        }
+#ifndef __linux__
+        free(ready);
+#endif
+
+        if(n > 0)
+            return n;
+        if(timeout_ms >= 0)
+        {
+            // only background flushes happened: wait for the rest of the timeout
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            if((now.tv_sec - start.tv_sec) * 1000 + (now.tv_nsec - start.tv_nsec) / 1000000
+               >= timeout_ms)
+                return 0;
+        }
+    }
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// Profiling counters. Every file counts its system calls, bytes, buffer hits and misses, evictions,
+// seeks and flushes; io61_profile_end adds them to its JSON record.
+
+/**
+ * [io61_clock monotonic time, for system call latencies]
+ * @return  [nanoseconds]
+ */
+long long io61_clock(void)
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000000000LL + t.tv_nsec;
+}
+
+/**
+ * [io61_count records a system call of type `type` made for `f`, which started at `start`
+ *             and returned `r`. Bytes are counted for reads, writes and kernel copies.]
+ * @param  f     [file; NULL for calls that belong to no file]
+ * @param  type  [SYS_READ ... SYS_POLL]
+ * @param  start [io61_clock() before the call]
+ * @param  r     [return value of the call, negative on failure]
+ * @return       [duration of the call in nanoseconds]
+ */
+long long io61_count(io61_file* f, int type, long long start, ssize_t r)
+{
+    io61_stats* s = f ? &f -> stats : &totals;
+    long long ns = io61_clock() - start;
+    long long us = ns / 1000;
+    int b = 0;
+    for(long long limit = 1; b < NLATENCY - 1 && us >= limit; limit *= 4)
+        b++;
+
+    __atomic_fetch_add(&s -> calls[type], 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&s -> latency[type][b], 1, __ATOMIC_RELAXED);
+    if(r < 0)
+        __atomic_fetch_add(&s -> errors, 1, __ATOMIC_RELAXED);
+    else if(type == SYS_READ || type == SYS_READV || type == SYS_PREAD)
+        __atomic_fetch_add(&s -> bytesin, r, __ATOMIC_RELAXED);
+    else if(type == SYS_WRITE || type == SYS_WRITEV || type == SYS_PWRITE || type == SYS_COPY)
+        __atomic_fetch_add(&s -> bytesout, r, __ATOMIC_RELAXED);
+    return ns;
+}
+
+/**
+ * [io61_addstats adds the counters `s` to `sum`]
+ * @param sum [total]
+ * @param s   [counters]
+ */
+void io61_addstats(io61_stats* sum, const io61_stats* s)
+{
+    for(int t = 0; t < NSYSCALLS; t++)
+    {
+        sum -> calls[t] += s -> calls[t];
+        for(int b = 0; b < NLATENCY; b++)
+            sum -> latency[t][b] += s -> latency[t][b];
+    }
+    sum -> errors += s -> errors;
+    sum -> bytesin += s -> bytesin;
+    sum -> bytesout += s -> bytesout;
+    sum -> hitbytes += s -> hitbytes;
+    sum -> misses += s -> misses;
+    sum -> evictions += s -> evictions;
+    sum -> seeks += s -> seeks;
+    sum -> flushes += s -> flushes;
+    if(s -> mempeak > sum -> mempeak)
+        sum -> mempeak = s -> mempeak;
+}
+
+/**
+ * [io61_jsonf appends printf-style output to the `size` bytes at `buf`, which hold `len` bytes.
+ *             Output that does not fit is dropped.]
+ * @param  buf  [buffer]
+ * @param  size [size of buffer]
+ * @param  len  [bytes already used]
+ * @param  fmt  [format]
+ * @return      [bytes used afterwards, at most size - 1]
+ */
+int io61_jsonf(char* buf, size_t size, int len, const char* fmt, ...)
+{
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(buf + len, size - len, fmt, ap);
+    va_end(ap);
+    if(n < 0 || (size_t) (len + n) >= size)
+    {
+        buf[len] = 0;
+        return len;
+    }
+    return len + n;
+}
+
+/**
+ * [io61_statsjson prints the counters `s` as JSON members: system calls by type, bytes, errors,
+ *                 hits, misses, evictions, seeks and flushes, and with `latency` the histogram
+ *                 of every system call type that was used]
+ * @param  buf     [buffer]
+ * @param  size    [size of buffer]
+ * @param  s       [counters]
+ * @param  latency [TRUE to include the latency histograms]
+ * @return         [number of bytes printed]
+ */
+int io61_statsjson(char* buf, size_t size, const io61_stats* s, int latency)
+{
+    int len = io61_jsonf(buf, size, 0, "\"calls\":{");
+    const char* sep = "";
+    for(int t = 0; t < NSYSCALLS; t++)
+        if(s -> calls[t])
+        {
+            len = io61_jsonf(buf, size, len, "%s\"%s\":%lu", sep, sysnames[t], s -> calls[t]);
+            sep = ", ";
+        }
+    len = io61_jsonf(buf, size, len, "}, \"errors\":%lu, \"bytesin\":%llu, \"bytesout\":%llu, "
+                     "\"hitbytes\":%llu, \"misses\":%lu, \"evictions\":%lu, \"seeks\":%lu, \"flushes\":%lu",
+                     s -> errors, s -> bytesin, s -> bytesout, s -> hitbytes, s -> misses,
+                     s -> evictions, s -> seeks, s -> flushes);
+    if(!latency)
+        return io61_jsonf(buf, size, len, ", \"mempeak\":%llu", s -> mempeak);
+
+    // bucket b counts calls that took less than 4^b microseconds (and at least 4^(b-1))
+    len = io61_jsonf(buf, size, len, ", \"latency_us\":{\"limits\":[");
+    for(int b = 0; b < NLATENCY - 1; b++)
+        len = io61_jsonf(buf, size, len, b ? ",%d" : "%d", 1 << (2 * b));
+    len = io61_jsonf(buf, size, len, "]");
+    for(int t = 0; t < NSYSCALLS; t++)
+        if(s -> calls[t])
+        {
+            len = io61_jsonf(buf, size, len, ", \"%s\":[", sysnames[t]);
+            for(int b = 0; b < NLATENCY; b++)
+                len = io61_jsonf(buf, size, len, b ? ",%lu" : "%lu", s -> latency[t][b]);
+            len = io61_jsonf(buf, size, len, "]");
+        }
+    return io61_jsonf(buf, size, len, "}");
+}
+
+/**
+ * [io61_profile_counters prints the counters of the whole process, then of the first files
+ *                        closed and of the files still open, as one JSON member "io61" that
+ *                        io61_profile_end appends to its record]
+ * @param  buf  [buffer]
+ * @param  size [size of buffer]
+ * @return      [number of bytes printed]
+ */
+int io61_profile_counters(char* buf, size_t size)
+{
+    static const char* modes[] = {"r", "w", "rw"};
+    pthread_mutex_lock(&statslock);
+    io61_stats sum = totals;
+    int nfiles = nclosed;
+    for(io61_file* f = openfiles; f; f = f -> statnext, nfiles++)
+        io61_addstats(&sum, &f -> stats);
+
+    int len = io61_jsonf(buf, size, 0, ", \"io61\":{\"nfiles\":%d, "
+                         "\"memory\":{\"budget\":%zu, \"used\":%zu, \"peak\":%zu}, ",
+                         nfiles, membudget, memused, mempeak);
+    len += io61_statsjson(buf + len, size - len, &sum, TRUE);
+    len = io61_jsonf(buf, size, len, ", \"files\":[");
+
+    int nkept = nclosed < NFILESTATS ? nclosed : NFILESTATS;
+    io61_file* f = openfiles;
+    for(int k = 0; k < NFILESTATS && (k < nkept || f); k++)
+    {
+        filestats fs;
+        if(k < nkept)
+            fs = closedstats[k];
+        else
+        {
+            fs.fd = f -> fd;
+            fs.mode = f -> mode;
+            fs.crc = f -> crc;
+            fs.crcin = f -> crcin;
+            fs.crcout = f -> crcout;
+            fs.stats = f -> stats;
+            f = f -> statnext;
+        }
+        len = io61_jsonf(buf, size, len, "%s{\"fd\":%d, \"mode\":\"%s\", ",
+                         k ? ", " : "", fs.fd, modes[fs.mode & O_ACCMODE]);
+        len += io61_statsjson(buf + len, size - len, &fs.stats, FALSE);
+        if(fs.crc)
+            len = io61_jsonf(buf, size, len, ", \"crc32c\":{\"in\":%u, \"out\":%u}", fs.crcin, fs.crcout);
+        len = io61_jsonf(buf, size, len, "}");
+    }
+    pthread_mutex_unlock(&statslock);
+
+    return io61_jsonf(buf, size, len, "]}");
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
@@ -522,9 +6856,11 @@ void quicksort(int first, int last)
 
 io61_file* io61_open_check(const char* filename, int mode) {
     int fd;
-    if (filename)
-        fd = open(filename, mode);
-    else if (mode == O_RDONLY)
+    if (filename) {
+        fd = open(filename, mode & ~IO61_MODEFLAGS);
+        if (fd < 0 && errno == EINVAL && (mode & O_DIRECT))
+            fd = open(filename, mode & ~(IO61_MODEFLAGS | O_DIRECT));
+    } else if ((mode & O_ACCMODE) == O_RDONLY)
         fd = STDIN_FILENO;
     else
         fd = STDOUT_FILENO;
@@ -541,6 +6877,8 @@ io61_file* io61_open_check(const char* filename, int mode) {
 //    file (for instance, if it is a pipe).
 
 ssize_t io61_filesize(io61_file* f) {
+    if(f -> zip && f -> mode == O_RDONLY)
+        return f -> zip -> rawsize;
     struct stat s;
     int r = fstat(f->fd, &s);
     if (r >= 0 && S_ISREG(s.st_mode) && s.st_size <= SSIZE_MAX)
@@ -6,9 +6,23 @@
 #include <stdlib.h>
 #include <string.h>
 #include <assert.h>
+#include <sys/uio.h>
+#include <poll.h>
 
 typedef struct io61_file io61_file;
+typedef struct io61_pollset io61_pollset;
 
+typedef struct io61_event {
+    io61_file* f;
+    int events;                 // POLLIN, POLLOUT, POLLERR, POLLHUP
+} io61_event;
+
+// Extra `mode` bits for io61_fdopen and io61_open_check, above those used by open(2).
+#define IO61_URING      0x40000000      // batch I/O through io_uring (Linux, regular files)
+#define IO61_ZIP        0x20000000      // compress what is written, decompress what is read
+
+// Different files may be used from different threads at once; each file must be used by one
+// thread at a time.
 io61_file* io61_fdopen(int fd, int mode);
 io61_file* io61_open_check(const char* filename, int mode);
 int io61_close(io61_file* f);
@@ -23,9 +37,54 @@ int io61_writec(io61_file* f, int ch);
 ssize_t io61_read(io61_file* f, char* buf, size_t sz);
 ssize_t io61_write(io61_file* f, const char* buf, size_t sz);
 
+ssize_t io61_readv(io61_file* f, const struct iovec* iov, int iovcnt);
+ssize_t io61_writev(io61_file* f, const struct iovec* iov, int iovcnt);
+
+ssize_t io61_read_strided(io61_file* f, size_t start, size_t stride,
+                          size_t blocksize, size_t count, char* buf);
+
+ssize_t io61_copy(io61_file* inf, io61_file* outf, size_t len);
+int io61_copy_threads(int n);
+
+ssize_t io61_read_until(io61_file* f, int delim, const char** data);
+ssize_t io61_readline(io61_file* f, const char** line);
+ssize_t io61_read_records(io61_file* f, size_t recsize, size_t max, const void** view);
+
+int io61_peek(io61_file* f, const char** ptr, size_t* len);
+int io61_consume(io61_file* f, size_t n);
+int io61_reserve(io61_file* f, char** ptr, size_t* len);
+int io61_commit(io61_file* f, size_t n);
+
 int io61_flush(io61_file* f);
+int io61_sync(io61_file* f);
+int io61_durable(io61_file* f, size_t bytes, long delay_us);
+ssize_t io61_bufsize(io61_file* f, size_t size);
+
+size_t io61_mem_budget(size_t bytes);
+size_t io61_mem_quota(io61_file* f, size_t bytes);
+size_t io61_mem_used(io61_file* f);
+
+int io61_async_start(io61_file* f, int nbufs);
+int io61_uring_start(io61_file* f);
+int io61_zip_start(io61_file* f);
+int io61_crc_start(io61_file* f, const char* sidecar);
+unsigned io61_crc(io61_file* f, int dir);
+
+int io61_msgmode(io61_file* f, size_t threshold, long delay_us);
+
+int io61_fileno(io61_file* f);
+ssize_t io61_try_read(io61_file* f, char* buf, size_t sz);
+ssize_t io61_try_write(io61_file* f, const char* buf, size_t sz);
+int io61_try_flush(io61_file* f);
+
+io61_pollset* io61_pollset_new(void);
+void io61_pollset_free(io61_pollset* ps);
+int io61_pollset_add(io61_pollset* ps, io61_file* f, int events);
+int io61_pollset_del(io61_pollset* ps, io61_file* f);
+int io61_poll(io61_pollset* ps, io61_event* events, int maxevents, int timeout_ms);
 
 void io61_profile_begin(void);
 void io61_profile_end(void);
+int io61_profile_counters(char* buf, size_t size);
 
 #endif
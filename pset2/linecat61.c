@@ -0,0 +1,21 @@
+#include "io61.h"
+
+// Usage: ./linecat61 [FILE]
+//    Copies the input FILE to standard output one line at a time, using
+//    io61_readline.
+
+int main(int argc, char** argv) {
+    const char* in_filename = argc >= 2 ? argv[1] : NULL;
+    io61_profile_begin();
+    io61_file* inf = io61_open_check(in_filename, O_RDONLY);
+    io61_file* outf = io61_fdopen(STDOUT_FILENO, O_WRONLY);
+
+    const char* line;
+    ssize_t len;
+    while ((len = io61_readline(inf, &line)) > 0)
+        io61_write(outf, line, len);
+
+    io61_close(inf);
+    io61_close(outf);
+    io61_profile_end();
+}
@@ -0,0 +1,59 @@
+#include "io61.h"
+
+// Usage: ./peekcat61 [-n MAXCHUNK] [FILE]
+//    Copies the input FILE to standard output without a buffer of its
+//    own: input is borrowed with io61_peek and output is produced in place
+//    in space from io61_reserve. Each step copies at most MAXCHUNK bytes,
+//    so a peeked buffer is usually consumed in several pieces. Default
+//    MAXCHUNK is 1000. Exits with status 1 on error.
+
+int main(int argc, char** argv) {
+    // Parse arguments
+    size_t maxchunk = 1000;
+    if (argc >= 3 && strcmp(argv[1], "-n") == 0) {
+        maxchunk = strtoul(argv[2], 0, 0);
+        argc -= 2, argv += 2;
+    }
+    assert(maxchunk > 0);
+
+    const char* in_filename = argc >= 2 ? argv[1] : NULL;
+    io61_profile_begin();
+    io61_file* inf = io61_open_check(in_filename, O_RDONLY);
+    io61_file* outf = io61_fdopen(STDOUT_FILENO, O_WRONLY);
+
+    // Copy file data
+    while (1) {
+        const char* in;
+        size_t inlen;
+        if (io61_peek(inf, &in, &inlen) != 0) {
+            perror("peekcat61: io61_peek");
+            exit(1);
+        }
+        if (inlen == 0)
+            break;
+
+        char* out;
+        size_t outlen;
+        if (io61_reserve(outf, &out, &outlen) != 0) {
+            perror("peekcat61: io61_reserve");
+            exit(1);
+        }
+
+        size_t n = inlen < outlen ? inlen : outlen;
+        if (n > maxchunk)
+            n = maxchunk;
+        memcpy(out, in, n);
+        if (io61_commit(outf, n) != 0 || io61_consume(inf, n) != 0) {
+            perror("peekcat61");
+            exit(1);
+        }
+    }
+
+    io61_close(inf);
+    int r = io61_close(outf);
+    io61_profile_end();
+    if (r != 0) {
+        fprintf(stderr, "peekcat61: output could not be written\n");
+        exit(1);
+    }
+}
@@ -1,3 +1,4 @@
+#define _GNU_SOURCE     // F_SETPIPE_SZ
 #include "io61.h"
 #include <sys/socket.h>
 #include <sys/un.h>
@@ -119,6 +120,10 @@ int main(int argc, char** argv) {
         perror("pipe");
         exit(1);
     }
+    // a batch of requests, and one of replies, must fit in its pipe: the
+    // requester writes the whole batch before it reads any reply
+    fcntl(request_fds[1], F_SETPIPE_SZ, 1 << 20);
+    fcntl(response_fds[1], F_SETPIPE_SZ, 1 << 20);
 
     // fork two children
     pid_t p1 = fork();
@@ -144,17 +149,22 @@ int main(int argc, char** argv) {
     }
 
     time_t start_time = time(0);
+    int ok = 1;                 /* children that died exited with status 0 */
     while ((p1 > 0 || p2 > 0) && time(0) < start_time + 5) {
         int status;
-        if (p1 > 0 && waitpid(p1, &status, WNOHANG) == p1)
+        if (p1 > 0 && waitpid(p1, &status, WNOHANG) == p1) {
             p1 = -1;            /* child1 has died */
-        if (p2 > 0 && waitpid(p2, &status, WNOHANG) == p2)
+            ok = ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+        }
+        if (p2 > 0 && waitpid(p2, &status, WNOHANG) == p2) {
             p2 = -1;            /* child2 has died */
+            ok = ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+        }
     }
 
     if (p1 > 0)
         kill(p1, SIGKILL);
     if (p2 > 0)
         kill(p2, SIGKILL);
-    exit(p1 < 0 && p2 < 0 ? 0 : 1);
+    exit(p1 < 0 && p2 < 0 && ok ? 0 : 1);
 }
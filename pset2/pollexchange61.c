@@ -0,0 +1,154 @@
+#include "io61.h"
+#include <errno.h>
+#include <sys/wait.h>
+
+// Usage: ./pollexchange61 [-b BLOCKSIZE] [FILE]
+//    Copies the input FILE to standard output by way of an echo child
+//    process. The parent never blocks: one thread relays FILE to the
+//    child and the child's replies to standard output with io61_try_read,
+//    io61_try_write and io61_poll, while the child copies its pipes with
+//    ordinary blocking calls. Default BLOCKSIZE is 4096. Exits with
+//    status 1 if a copy failed.
+
+typedef struct relay {
+    io61_file* from;
+    io61_file* to;
+    char* buf;
+    size_t head;                // bytes of `buf` written to `to`
+    size_t tail;                // bytes of `buf` read from `from`
+    int state;
+} relay;
+
+enum { READING, WRITING, FLUSHING, DONE };
+
+// Change the files `r` waits for to those of `state`
+static void relay_watch(io61_pollset* ps, relay* r, int state) {
+    if (r->state == READING)
+        io61_pollset_del(ps, r->from);
+    if (r->state != DONE)
+        io61_pollset_del(ps, r->to);
+    if (state == READING) {
+        io61_pollset_add(ps, r->from, POLLIN);
+        io61_pollset_add(ps, r->to, 0);
+    } else if (state != DONE)
+        io61_pollset_add(ps, r->to, POLLOUT);
+    r->state = state;
+}
+
+// Make whatever progress `r` can without blocking; `f` is ready
+static void relay_step(io61_pollset* ps, relay* r, io61_file* f, int events,
+                       size_t blocksize) {
+    if (r->state == READING && f == r->from
+        && (events & (POLLIN | POLLHUP | POLLERR))) {
+        ssize_t n = io61_try_read(r->from, r->buf, blocksize);
+        if (n > 0) {
+            r->head = 0;
+            r->tail = n;
+            relay_watch(ps, r, WRITING);
+        } else if (n == 0)
+            relay_watch(ps, r, FLUSHING);
+        else if (errno != EAGAIN) {
+            perror("pollexchange61: read");
+            exit(1);
+        }
+    } else if (r->state == WRITING && f == r->to) {
+        ssize_t n = io61_try_write(r->to, r->buf + r->head, r->tail - r->head);
+        if (n > 0)
+            r->head += n;
+        else if (n < 0 && errno != EAGAIN) {
+            perror("pollexchange61: write");
+            exit(1);
+        }
+        if (r->head == r->tail)
+            relay_watch(ps, r, READING);
+    } else if (r->state == FLUSHING && f == r->to) {
+        if (io61_try_flush(r->to) == 0) {
+            relay_watch(ps, r, DONE);
+            if (io61_close(r->to) != 0) {
+                fprintf(stderr, "pollexchange61: output could not be written\n");
+                exit(1);
+            }
+            io61_close(r->from);
+        } else if (errno != EAGAIN) {
+            perror("pollexchange61: flush");
+            exit(1);
+        }
+    }
+}
+
+int main(int argc, char** argv) {
+    // Parse arguments
+    size_t blocksize = 4096;
+    if (argc >= 3 && strcmp(argv[1], "-b") == 0) {
+        blocksize = strtoul(argv[2], 0, 0);
+        argc -= 2, argv += 2;
+    }
+    assert(blocksize > 0);
+
+    // Start the echo child
+    int request_fds[2], response_fds[2];
+    if (pipe(request_fds) < 0 || pipe(response_fds) < 0) {
+        perror("pipe");
+        exit(1);
+    }
+    pid_t p = fork();
+    if (p == 0) {
+        close(request_fds[1]);
+        close(response_fds[0]);
+        io61_file* inf = io61_fdopen(request_fds[0], O_RDONLY);
+        io61_file* outf = io61_fdopen(response_fds[1], O_WRONLY);
+        char* buf = malloc(blocksize);
+        ssize_t amount;
+        while ((amount = io61_read(inf, buf, blocksize)) > 0)
+            io61_write(outf, buf, amount);
+        io61_close(inf);
+        exit(io61_close(outf) == 0 ? 0 : 1);
+    } else if (p < 0) {
+        perror("fork");
+        exit(1);
+    }
+    close(request_fds[0]);
+    close(response_fds[1]);
+
+    const char* in_filename = argc >= 2 ? argv[1] : NULL;
+    io61_profile_begin();
+    relay relays[2];
+    relays[0].from = io61_open_check(in_filename, O_RDONLY);
+    relays[0].to = io61_fdopen(request_fds[1], O_WRONLY);
+    relays[1].from = io61_fdopen(response_fds[0], O_RDONLY);
+    relays[1].to = io61_fdopen(STDOUT_FILENO, O_WRONLY);
+
+    io61_pollset* ps = io61_pollset_new();
+    if (!ps) {
+        perror("pollexchange61");
+        exit(1);
+    }
+    for (int k = 0; k < 2; ++k) {
+        relays[k].buf = malloc(blocksize);
+        relays[k].state = DONE;
+        relay_watch(ps, &relays[k], READING);
+    }
+
+    // Relay until both directions reach end of file
+    io61_event events[4];
+    while (relays[0].state != DONE || relays[1].state != DONE) {
+        int n = io61_poll(ps, events, 4, -1);
+        if (n < 0) {
+            perror("pollexchange61: poll");
+            exit(1);
+        }
+        for (int e = 0; e < n; ++e)
+            for (int k = 0; k < 2; ++k)
+                relay_step(ps, &relays[k], events[e].f, events[e].events,
+                           blocksize);
+    }
+
+    io61_pollset_free(ps);
+    io61_profile_end();
+    int status;
+    if (waitpid(p, &status, 0) != p
+        || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "pollexchange61: echo child failed\n");
+        exit(1);
+    }
+}
@@ -0,0 +1,45 @@
+#include "io61.h"
+#include <errno.h>
+
+// Usage: ./reccat61 [-r RECSIZE] [-n MAXRECORDS] [FILE]
+//    Copies the input FILE to standard output in batches of fixed-size
+//    records, using io61_read_records. A partial record at the end of the
+//    file is copied with io61_read. Default RECSIZE is 320 and default
+//    MAXRECORDS is 4096.
+
+int main(int argc, char** argv) {
+    // Parse arguments
+    size_t recsize = 320;
+    size_t maxrecords = 4096;
+    while (argc >= 3) {
+        if (strcmp(argv[1], "-r") == 0) {
+            recsize = strtoul(argv[2], 0, 0);
+            argc -= 2, argv += 2;
+        } else if (strcmp(argv[1], "-n") == 0) {
+            maxrecords = strtoul(argv[2], 0, 0);
+            argc -= 2, argv += 2;
+        } else
+            break;
+    }
+    assert(recsize > 0 && maxrecords > 0);
+
+    const char* in_filename = argc >= 2 ? argv[1] : NULL;
+    io61_profile_begin();
+    io61_file* inf = io61_open_check(in_filename, O_RDONLY);
+    io61_file* outf = io61_fdopen(STDOUT_FILENO, O_WRONLY);
+
+    const void* records;
+    ssize_t n;
+    while ((n = io61_read_records(inf, recsize, maxrecords, &records)) > 0)
+        io61_write(outf, (const char*) records, n * recsize);
+
+    if (n < 0 && errno == EIO) {
+        char buf[BUFSIZ];
+        while ((n = io61_read(inf, buf, sizeof(buf))) > 0)
+            io61_write(outf, buf, n);
+    }
+
+    io61_close(inf);
+    io61_close(outf);
+    io61_profile_end();
+}
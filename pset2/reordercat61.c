@@ -3,7 +3,8 @@
 // Usage: ./reordercat61 [-b BLOCKSIZE] [-S SEED] [FILE]
 //    Copies the input FILE to standard output in blocks. The blocks
 //    are transferred in random order, but the resulting output file
-//    should be the same as the input. Default BLOCKSIZE is 4096.
+//    should be the same as the input. Default BLOCKSIZE is 4096. Exits
+//    with status 1 if the output could not be written.
 
 int main(int argc, char** argv) {
     // Parse arguments
@@ -72,6 +73,10 @@ int main(int argc, char** argv) {
     }
 
     io61_close(inf);
-    io61_close(outf);
+    int r = io61_close(outf);
     io61_profile_end();
+    if (r != 0) {
+        perror("reordercat61");
+        exit(1);
+    }
 }
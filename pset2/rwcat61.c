@@ -0,0 +1,103 @@
+#include "io61.h"
+
+// Usage: ./rwcat61 [-b BLOCKSIZE] [-S SEED] INFILE OUTFILE
+//    Copies INFILE to OUTFILE through a single read/write handle on
+//    OUTFILE. The blocks are first written in random order with every
+//    byte's bit 5 flipped; then each block is read back, in another random
+//    order, and rewritten with the flip undone. The resulting output file
+//    should be the same as the input. Default BLOCKSIZE is 4096. Exits
+//    with status 1 if the output could not be written.
+
+static void shuffle(size_t* blockpos, size_t nblocks) {
+    for (size_t i = 0; i < nblocks; ++i)
+        blockpos[i] = i;
+    for (size_t i = nblocks; i > 1; --i) {
+        size_t j = random() % i;
+        size_t t = blockpos[i - 1];
+        blockpos[i - 1] = blockpos[j];
+        blockpos[j] = t;
+    }
+}
+
+static void flip(char* buf, size_t n) {
+    for (size_t i = 0; i < n; ++i)
+        buf[i] ^= 0x20;
+}
+
+int main(int argc, char** argv) {
+    // Parse arguments
+    size_t blocksize = 4096;
+    srandom(83419);
+    while (argc >= 3) {
+        if (strcmp(argv[1], "-b") == 0) {
+            blocksize = strtoul(argv[2], 0, 0);
+            argc -= 2, argv += 2;
+        } else if (strcmp(argv[1], "-S") == 0) {
+            srandom(strtoul(argv[2], 0, 0));
+            argc -= 2, argv += 2;
+        } else
+            break;
+    }
+    if (argc != 3) {
+        fprintf(stderr, "Usage: rwcat61 [-b BLOCKSIZE] [-S SEED] INFILE OUTFILE\n");
+        exit(1);
+    }
+
+    // Allocate buffer, open files, measure file sizes
+    assert(blocksize > 0);
+    char* buf = malloc(blocksize);
+
+    io61_profile_begin();
+    io61_file* inf = io61_open_check(argv[1], O_RDONLY);
+    int fd = open(argv[2], O_RDWR | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0) {
+        perror(argv[2]);
+        exit(1);
+    }
+    io61_file* f = io61_fdopen(fd, O_RDWR);
+
+    size_t inf_size = io61_filesize(inf);
+    if ((ssize_t) inf_size < 0) {
+        fprintf(stderr, "rwcat61: input file is not seekable\n");
+        exit(1);
+    }
+
+    size_t nblocks = (inf_size + blocksize - 1) / blocksize;
+    size_t* blockpos = (size_t*) malloc(sizeof(size_t) * (nblocks + 1));
+
+    // Write flipped blocks in random order
+    shuffle(blockpos, nblocks);
+    for (size_t i = 0; i < nblocks; ++i) {
+        size_t pos = blockpos[i] * blocksize;
+        io61_seek(inf, pos);
+        ssize_t amount = io61_read(inf, buf, blocksize);
+        if (amount <= 0)
+            break;
+        flip(buf, amount);
+        io61_seek(f, pos);
+        io61_write(f, buf, amount);
+    }
+
+    // Read them back in another order and unflip them in place
+    shuffle(blockpos, nblocks);
+    for (size_t i = 0; i < nblocks; ++i) {
+        size_t pos = blockpos[i] * blocksize;
+        io61_seek(f, pos);
+        ssize_t amount = io61_read(f, buf, blocksize);
+        if (amount <= 0)
+            break;
+        flip(buf, amount);
+        io61_seek(f, pos);
+        io61_write(f, buf, amount);
+    }
+
+    io61_close(inf);
+    int r = io61_close(f);
+    io61_profile_end();
+    free(blockpos);
+    free(buf);
+    if (r != 0) {
+        fprintf(stderr, "rwcat61: output could not be written\n");
+        exit(1);
+    }
+}
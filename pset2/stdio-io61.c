@@ -14,19 +14,37 @@
 
 struct io61_file {
     FILE* f;
+    char* line;         // io61_read_until
+    size_t linecap;
+    size_t rectail;     // io61_read_records: partial record held in `line`
+    size_t recoff;      // ...at this offset; io61_read returns it first
+};
+
+
+// io61_pollset
+//    Set of files to wait on with io61_poll.
+
+struct io61_pollset {
+    io61_file** files;
+    int* events;
+    int n;
+    int cap;
 };
 
 
 // io61_fdopen(fd, mode)
 //    Return a new io61_file that reads from and/or writes to the given
-//    file descriptor `fd`. `mode` is either O_RDONLY for a read-only file
-//    or O_WRONLY for a write-only file. You need not support read/write
-//    files.
+//    file descriptor `fd`. `mode` is O_RDONLY for a read-only file,
+//    O_WRONLY for a write-only file or O_RDWR for a read/write file; a
+//    read/write file must be seeked between reads and writes.
 
 io61_file* io61_fdopen(int fd, int mode) {
     assert(fd >= 0);
     io61_file* f = (io61_file*) malloc(sizeof(io61_file));
-    f->f = fdopen(fd, mode == O_RDONLY ? "r" : "w");
+    f->f = fdopen(fd, mode == O_RDONLY ? "r" : mode == O_RDWR ? "r+" : "w");
+    f->line = NULL;
+    f->linecap = 0;
+    f->rectail = 0;
     return f;
 }
 
@@ -35,8 +53,12 @@ io61_file* io61_fdopen(int fd, int mode) {
 //    Close the io61_file `f`.
 
 int io61_close(io61_file* f) {
-    io61_flush(f);
-    int r = fclose(f->f);
+    int r = io61_flush(f);
+    if (ferror(f->f))
+        r = -1;
+    if (fclose(f->f) != 0)
+        r = -1;
+    free(f->line);
     free(f);
     return r;
 }
@@ -47,6 +69,10 @@ int io61_close(io61_file* f) {
 //    (which is -1) on error or end-of-file.
 
 int io61_readc(io61_file* f) {
+    if (f->rectail) {
+        --f->rectail;
+        return (unsigned char) f->line[f->recoff++];
+    }
     return fgetc(f->f);
 }
 
@@ -75,7 +101,11 @@ int io61_flush(io61_file* f) {
 //    -1 an error occurred before any characters were read.
 
 ssize_t io61_read(io61_file* f, char* buf, size_t sz) {
-    size_t n = fread(buf, 1, sz, f->f);
+    size_t held = f->rectail < sz ? f->rectail : sz;
+    memcpy(buf, f->line + f->recoff, held);
+    f->recoff += held;
+    f->rectail -= held;
+    size_t n = held + fread(buf + held, 1, sz - held, f->f);
     if (n)
         return (ssize_t) n;
     else if (feof(f->f))
@@ -101,15 +131,386 @@ ssize_t io61_write(io61_file* f, const char* buf, size_t sz) {
 }
 
 
+// io61_readv(f, iov, iovcnt)
+//    Read into the `iovcnt` fragments of `iov` from `f`, in order. Returns
+//    the number of characters read, which is short if the file ended
+//    first, or -1 if an error occurred before any characters were read.
+
+ssize_t io61_readv(io61_file* f, const struct iovec* iov, int iovcnt) {
+    size_t nread = 0;
+    for (int k = 0; k < iovcnt; ++k) {
+        ssize_t n = io61_read(f, (char*) iov[k].iov_base, iov[k].iov_len);
+        if (n < 0)
+            return nread ? (ssize_t) nread : -1;
+        nread += n;
+        if ((size_t) n < iov[k].iov_len)
+            break;
+    }
+    return nread;
+}
+
+
+// io61_writev(f, iov, iovcnt)
+//    Write the `iovcnt` fragments of `iov` to `f`, in order. Returns the
+//    number of characters written, or -1 if an error occurred before any
+//    characters were written.
+
+ssize_t io61_writev(io61_file* f, const struct iovec* iov, int iovcnt) {
+    size_t nwritten = 0;
+    for (int k = 0; k < iovcnt; ++k) {
+        ssize_t n = io61_write(f, (const char*) iov[k].iov_base, iov[k].iov_len);
+        if (n < 0)
+            return nwritten ? (ssize_t) nwritten : -1;
+        nwritten += n;
+        if ((size_t) n < iov[k].iov_len)
+            break;
+    }
+    return nwritten;
+}
+
+
+// io61_read_strided(f, start, stride, blocksize, count, buf)
+//    Read `count` blocks of `blocksize` characters from positions `start`,
+//    `start + stride`, `start + 2 * stride`, ... of `f` into `buf`, one
+//    after another. Returns the number of characters read, which is short
+//    if the file ended first, or -1 if an error occurred before any
+//    characters were read.
+
+ssize_t io61_read_strided(io61_file* f, size_t start, size_t stride,
+                          size_t blocksize, size_t count, char* buf) {
+    size_t nread = 0;
+    for (size_t k = 0; k < count; ++k) {
+        if (io61_seek(f, start + k * stride) == -1)
+            return nread ? (ssize_t) nread : -1;
+        ssize_t n = io61_read(f, buf + nread, blocksize);
+        if (n <= 0)
+            return nread ? (ssize_t) nread : n;
+        nread += n;
+        if ((size_t) n < blocksize)
+            break;
+    }
+    return nread;
+}
+
+
+// io61_copy(inf, outf, len)
+//    Copy up to `len` characters from `inf` to `outf`, stopping early at
+//    end of file. Returns the number of characters copied, or -1 if an
+//    error occurred before any characters were copied.
+
+ssize_t io61_copy(io61_file* inf, io61_file* outf, size_t len) {
+    char buf[4096];
+    size_t ncopied = 0;
+    while (ncopied != len) {
+        size_t chunk = len - ncopied < sizeof(buf) ? len - ncopied : sizeof(buf);
+        ssize_t n = io61_read(inf, buf, chunk);
+        if (n <= 0)
+            break;
+        if (io61_write(outf, buf, n) != n)
+            return ncopied ? (ssize_t) ncopied : -1;
+        ncopied += n;
+    }
+    return ncopied;
+}
+
+
+// io61_read_until(f, delim, data)
+//    Read from `f` up to and including the next `delim` byte. `*data` is
+//    set to the record, which stays valid until the next call on `f`.
+//    Returns the record length, 0 at end of file, or -1 on error.
+
+ssize_t io61_read_until(io61_file* f, int delim, const char** data) {
+    ssize_t n = getdelim(&f->line, &f->linecap, delim, f->f);
+    *data = f->line;
+    if (n < 0)
+        return ferror(f->f) ? -1 : 0;
+    return n;
+}
+
+
+// io61_readline(f, line)
+//    Read the next line of `f`, including its newline.
+
+ssize_t io61_readline(io61_file* f, const char** line) {
+    return io61_read_until(f, '\n', line);
+}
+
+
+// io61_read_records(f, recsize, max, view)
+//    Read up to `max` records of `recsize` bytes from `f`. `*view` is set
+//    to the records, which stay valid until the next call on `f`. Returns
+//    the number of records, 0 at end of file, or -1 on error (errno EIO if
+//    the file ends inside a record, whose bytes are left for io61_read).
+
+ssize_t io61_read_records(io61_file* f, size_t recsize, size_t max,
+                          const void** view) {
+    size_t n = recsize < 65536 ? 65536 / recsize : 1;
+    if (n > max)
+        n = max;
+    if (n * recsize > f->linecap) {
+        f->linecap = n * recsize;
+        f->line = (char*) realloc(f->line, f->linecap);
+    }
+    // a partial last record stays held for the next call or io61_read
+    size_t held = f->rectail;
+    memmove(f->line, f->line + f->recoff, held);
+    f->rectail = 0;
+    size_t r = held + fread(f->line + held, 1, n * recsize - held, f->f);
+    if (r == 0)
+        return ferror(f->f) ? -1 : 0;
+    f->rectail = r % recsize;
+    f->recoff = r - f->rectail;
+    if (r < recsize) {
+        errno = EIO;
+        return -1;
+    }
+    *view = f->line;
+    return r / recsize;
+}
+
+
+// io61_peek(f, ptr, len)
+//    Set `*ptr` to the next bytes of `f` and `*len` to their number (0 at
+//    end of file) without consuming them. Returns 0 on success or -1 on
+//    error.
+
+int io61_peek(io61_file* f, const char** ptr, size_t* len) {
+    if (f->rectail == 0) {
+        if (f->linecap < 4096) {
+            f->linecap = 4096;
+            f->line = (char*) realloc(f->line, f->linecap);
+        }
+        ssize_t n = fread(f->line, 1, f->linecap, f->f);
+        if (n == 0 && ferror(f->f))
+            n = -1;
+        if (n < 0)
+            return -1;
+        f->recoff = 0;
+        f->rectail = n;
+    }
+    *ptr = f->line + f->recoff;
+    *len = f->rectail;
+    return 0;
+}
+
+
+// io61_consume(f, n)
+//    Consume `n` of the bytes returned by io61_peek. Returns 0 on success
+//    or -1 if fewer than `n` bytes were peeked.
+
+int io61_consume(io61_file* f, size_t n) {
+    if (n > f->rectail) {
+        errno = EINVAL;
+        return -1;
+    }
+    f->recoff += n;
+    f->rectail -= n;
+    return 0;
+}
+
+
+// io61_reserve(f, ptr, len)
+//    Set `*ptr` to space for the next bytes written to `f` and `*len` to
+//    its size. Returns 0 on success or -1 on error.
+
+int io61_reserve(io61_file* f, char** ptr, size_t* len) {
+    if (f->linecap < 4096) {
+        f->linecap = 4096;
+        f->line = (char*) realloc(f->line, f->linecap);
+    }
+    *ptr = f->line;
+    *len = f->linecap;
+    return 0;
+}
+
+
+// io61_commit(f, n)
+//    Write the first `n` bytes of the space returned by io61_reserve.
+//    Returns 0 on success or -1 on error.
+
+int io61_commit(io61_file* f, size_t n) {
+    if (n > f->linecap) {
+        errno = EINVAL;
+        return -1;
+    }
+    return n == 0 || io61_write(f, f->line, n) == (ssize_t) n ? 0 : -1;
+}
+
+
+// io61_bufsize(f, size)
+//    Set the buffer size of `f` to `size` bytes and return it; 0 only
+//    returns it. This version leaves stdio's buffer alone.
+
+ssize_t io61_bufsize(io61_file* f, size_t size) {
+    (void) f;
+    return size ? size : BUFSIZ;
+}
+
+
 // io61_seek(f, pos)
 //    Change the file pointer for file `f` to `pos` bytes into the file.
 //    Returns 0 on success and -1 on failure.
 
 int io61_seek(io61_file* f, size_t pos) {
+    f->rectail = 0;
     return fseek(f->f, pos, SEEK_SET);
 }
 
 
+// io61_fileno(f)
+//    Return the file descriptor of `f`.
+
+int io61_fileno(io61_file* f) {
+    return fileno(f->f);
+}
+
+
+// io61_try_read(f, buf, sz)
+//    Read up to `sz` characters from `f` without waiting. Returns the
+//    number of characters read, 0 at end of file, or -1 with errno EAGAIN
+//    if no input is ready. This version reads the file descriptor
+//    directly, so a file read this way must not use the other reads.
+
+ssize_t io61_try_read(io61_file* f, char* buf, size_t sz) {
+    struct pollfd p = { fileno(f->f), POLLIN, 0 };
+    if (poll(&p, 1, 0) == 0) {
+        errno = EAGAIN;
+        return -1;
+    }
+    return read(fileno(f->f), buf, sz);
+}
+
+
+// io61_try_write(f, buf, sz)
+//    Write up to `sz` characters to `f` without waiting. Returns the
+//    number of characters written, or -1 with errno EAGAIN if none could
+//    be. Like io61_try_read, this version uses the file descriptor
+//    directly.
+
+ssize_t io61_try_write(io61_file* f, const char* buf, size_t sz) {
+    struct pollfd p = { fileno(f->f), POLLOUT, 0 };
+    if (poll(&p, 1, 0) == 0) {
+        errno = EAGAIN;
+        return -1;
+    }
+    return write(fileno(f->f), buf, sz < PIPE_BUF ? sz : PIPE_BUF);
+}
+
+
+// io61_try_flush(f)
+//    Write buffered output of `f`. This version buffers nothing for
+//    io61_try_write.
+
+int io61_try_flush(io61_file* f) {
+    return io61_flush(f);
+}
+
+
+// io61_pollset_new()
+//    Return an empty set of files to wait on with io61_poll, or NULL on
+//    error.
+
+io61_pollset* io61_pollset_new(void) {
+    io61_pollset* ps = (io61_pollset*) malloc(sizeof(io61_pollset));
+    if (ps) {
+        ps->files = NULL;
+        ps->events = NULL;
+        ps->n = ps->cap = 0;
+    }
+    return ps;
+}
+
+
+// io61_pollset_free(ps)
+//    Free `ps`. Its files stay open.
+
+void io61_pollset_free(io61_pollset* ps) {
+    free(ps->files);
+    free(ps->events);
+    free(ps);
+}
+
+
+// io61_pollset_add(ps, f, events)
+//    Add `f` to `ps`, waiting for `events` (POLLIN and/or POLLOUT).
+//    Returns 0 on success or -1 on error.
+
+int io61_pollset_add(io61_pollset* ps, io61_file* f, int events) {
+    if (ps->n == ps->cap) {
+        int cap = ps->cap ? 2 * ps->cap : 8;
+        io61_file** files = (io61_file**) realloc(ps->files, sizeof(io61_file*) * cap);
+        if (!files)
+            return -1;
+        ps->files = files;
+        int* evs = (int*) realloc(ps->events, sizeof(int) * cap);
+        if (!evs)
+            return -1;
+        ps->events = evs;
+        ps->cap = cap;
+    }
+    ps->files[ps->n] = f;
+    ps->events[ps->n] = events;
+    ++ps->n;
+    return 0;
+}
+
+
+// io61_pollset_del(ps, f)
+//    Remove `f` from `ps`. Returns 0 on success or -1 if `f` is not in
+//    the set.
+
+int io61_pollset_del(io61_pollset* ps, io61_file* f) {
+    for (int k = 0; k < ps->n; ++k)
+        if (ps->files[k] == f) {
+            --ps->n;
+            ps->files[k] = ps->files[ps->n];
+            ps->events[k] = ps->events[ps->n];
+            return 0;
+        }
+    return -1;
+}
+
+
+// io61_poll(ps, events, maxevents, timeout_ms)
+//    Wait up to `timeout_ms` milliseconds (-1 means forever) until files
+//    of `ps` are ready, and store up to `maxevents` of them in `events`.
+//    Returns the number of ready files, 0 on timeout, or -1 on error.
+
+int io61_poll(io61_pollset* ps, io61_event* events, int maxevents, int timeout_ms) {
+    struct pollfd* p = (struct pollfd*) malloc(sizeof(struct pollfd) * (ps->n ? ps->n : 1));
+    if (!p)
+        return -1;
+    for (int k = 0; k < ps->n; ++k) {
+        p[k].fd = io61_fileno(ps->files[k]);
+        p[k].events = ps->events[k];
+    }
+    int r;
+    do {
+        r = poll(p, ps->n, timeout_ms);
+    } while (r == -1 && errno == EINTR);
+    int n = 0;
+    for (int k = 0; r > 0 && k < ps->n && n < maxevents; ++k)
+        if (p[k].revents) {
+            events[n].f = ps->files[k];
+            events[n].events = p[k].revents;
+            ++n;
+        }
+    free(p);
+    return r < 0 ? -1 : n;
+}
+
+
+// io61_profile_counters(buf, size)
+//    Print this library's own counters as JSON members for
+//    io61_profile_end(). This version keeps none.
+
+int io61_profile_counters(char* buf, size_t size) {
+    (void) size;
+    buf[0] = 0;
+    return 0;
+}
+
+
 // You should not need to change either of these functions.
 
 // io61_open_check(filename, mode)
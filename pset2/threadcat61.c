@@ -0,0 +1,112 @@
+#include "io61.h"
+#include <pthread.h>
+
+// Usage: ./threadcat61 [-b BLOCKSIZE] [-S SEED] INFILE OUTFILE [INFILE OUTFILE...]
+//    Copies each INFILE to its OUTFILE on a thread of its own. As in
+//    reordercat61, the blocks are transferred in random order, so the
+//    threads' files share the block cache. Default BLOCKSIZE is 4096.
+//    Exits with status 1 if an output could not be written.
+
+typedef struct copyjob {
+    const char* in_filename;
+    const char* out_filename;
+    size_t blocksize;
+    unsigned seed;
+    int status;
+} copyjob;
+
+static void* copy_thread(void* arg) {
+    copyjob* job = (copyjob*) arg;
+    char* buf = malloc(job->blocksize);
+    io61_file* inf = io61_open_check(job->in_filename, O_RDONLY);
+    int fd = open(job->out_filename, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0) {
+        perror(job->out_filename);
+        exit(1);
+    }
+    io61_file* outf = io61_fdopen(fd, O_WRONLY);
+
+    size_t inf_size = io61_filesize(inf);
+    if ((ssize_t) inf_size < 0) {
+        fprintf(stderr, "threadcat61: %s is not seekable\n", job->in_filename);
+        exit(1);
+    }
+
+    // Calculate random permutation of file's blocks; a short last
+    // block is copied too
+    size_t nblocks = (inf_size + job->blocksize - 1) / job->blocksize;
+    size_t* blockpos = (size_t*) malloc(sizeof(size_t) * (nblocks + 1));
+    for (size_t i = 0; i < nblocks; ++i)
+        blockpos[i] = i;
+
+    // Copy file data
+    while (nblocks != 0) {
+        size_t index = rand_r(&job->seed) % nblocks;
+        size_t pos = blockpos[index] * job->blocksize;
+        blockpos[index] = blockpos[nblocks - 1];
+        --nblocks;
+
+        io61_seek(inf, pos);
+        ssize_t amount = io61_read(inf, buf, job->blocksize);
+        if (amount <= 0)
+            break;
+        io61_seek(outf, pos);
+        io61_write(outf, buf, amount);
+    }
+
+    io61_close(inf);
+    job->status = io61_close(outf);
+    free(blockpos);
+    free(buf);
+    return NULL;
+}
+
+int main(int argc, char** argv) {
+    // Parse arguments
+    size_t blocksize = 4096;
+    unsigned seed = 83419;
+    while (argc >= 3) {
+        if (strcmp(argv[1], "-b") == 0) {
+            blocksize = strtoul(argv[2], 0, 0);
+            argc -= 2, argv += 2;
+        } else if (strcmp(argv[1], "-S") == 0) {
+            seed = strtoul(argv[2], 0, 0);
+            argc -= 2, argv += 2;
+        } else
+            break;
+    }
+    if (argc < 3 || argc % 2 == 0) {
+        fprintf(stderr, "Usage: threadcat61 [-b BLOCKSIZE] [-S SEED] INFILE OUTFILE [INFILE OUTFILE...]\n");
+        exit(1);
+    }
+    assert(blocksize > 0);
+
+    // Start one thread per pair of files
+    int njobs = (argc - 1) / 2;
+    copyjob* jobs = (copyjob*) malloc(sizeof(copyjob) * njobs);
+    pthread_t* threads = (pthread_t*) malloc(sizeof(pthread_t) * njobs);
+    io61_profile_begin();
+    for (int i = 0; i < njobs; ++i) {
+        jobs[i].in_filename = argv[1 + 2 * i];
+        jobs[i].out_filename = argv[2 + 2 * i];
+        jobs[i].blocksize = blocksize;
+        jobs[i].seed = seed + i;
+        jobs[i].status = 0;
+        if (pthread_create(&threads[i], NULL, copy_thread, &jobs[i]) != 0) {
+            perror("threadcat61");
+            exit(1);
+        }
+    }
+
+    int r = 0;
+    for (int i = 0; i < njobs; ++i) {
+        pthread_join(threads[i], NULL);
+        if (jobs[i].status != 0)
+            r = 1;
+    }
+    io61_profile_end();
+    if (r != 0) {
+        fprintf(stderr, "threadcat61: an output could not be written\n");
+        exit(1);
+    }
+}
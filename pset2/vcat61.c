@@ -0,0 +1,67 @@
+#include "io61.h"
+
+// Usage: ./vcat61 [-b BLOCKSIZE] [-n COUNT] [FILE]
+//    Copies the input FILE to standard output in batches of COUNT
+//    fragments of different sizes, up to BLOCKSIZE each. Each batch is
+//    read with one call to io61_readv and written with one call to
+//    io61_writev, with the fragments in reverse order. Default BLOCKSIZE
+//    is 4096 and default COUNT is 16.
+
+int main(int argc, char** argv) {
+    // Parse arguments
+    size_t blocksize = 4096;
+    int count = 16;
+    while (argc >= 3) {
+        if (strcmp(argv[1], "-b") == 0) {
+            blocksize = strtoul(argv[2], 0, 0);
+            argc -= 2, argv += 2;
+        } else if (strcmp(argv[1], "-n") == 0) {
+            count = strtol(argv[2], 0, 0);
+            argc -= 2, argv += 2;
+        } else
+            break;
+    }
+    assert(blocksize > 0 && count > 0);
+
+    // Allocate fragments of sizes between 1 and BLOCKSIZE
+    char* buf = malloc(blocksize * count);
+    struct iovec* iniov = (struct iovec*) malloc(sizeof(struct iovec) * count);
+    struct iovec* outiov = (struct iovec*) malloc(sizeof(struct iovec) * count);
+    for (int k = 0; k < count; ++k) {
+        iniov[k].iov_base = buf + k * blocksize;
+        iniov[k].iov_len = 1 + (k * 2657 + blocksize - 1) % blocksize;
+    }
+
+    const char* in_filename = argc >= 2 ? argv[1] : NULL;
+    io61_profile_begin();
+    io61_file* inf = io61_open_check(in_filename, O_RDONLY);
+    io61_file* outf = io61_fdopen(STDOUT_FILENO, O_WRONLY);
+
+    // Copy file data; a short batch fills the leading fragments
+    while (1) {
+        ssize_t amount = io61_readv(inf, iniov, count);
+        if (amount <= 0)
+            break;
+        int n = 0;
+        while (amount > 0) {
+            outiov[n].iov_base = iniov[n].iov_base;
+            outiov[n].iov_len = (size_t) amount < iniov[n].iov_len
+                ? (size_t) amount : iniov[n].iov_len;
+            amount -= outiov[n].iov_len;
+            ++n;
+        }
+        for (int k = 0; k < n / 2; ++k) {
+            struct iovec t = outiov[k];
+            outiov[k] = outiov[n - 1 - k];
+            outiov[n - 1 - k] = t;
+        }
+        io61_writev(outf, outiov, n);
+    }
+
+    io61_close(inf);
+    io61_close(outf);
+    io61_profile_end();
+    free(outiov);
+    free(iniov);
+    free(buf);
+}